@@ -2,9 +2,23 @@
 Daikin S21 Mini-Split ESPHome component config validation & code generation.
 """
 
+from esphome import automation
 import esphome.codegen as cg
 import esphome.config_validation as cv
-from esphome.const import CONF_ID
+from esphome.components import time as time_, web_server_base
+from esphome.const import (
+    CONF_ADDRESS,
+    CONF_CODE,
+    CONF_ENABLED,
+    CONF_ID,
+    CONF_INTERVAL,
+    CONF_PATH,
+    CONF_PORT,
+    CONF_PRIORITY,
+    CONF_TIME_ID,
+    CONF_WEB_SERVER_BASE_ID,
+)
+from esphome.core import CORE, ID
 
 DEPENDENCIES = ["uart"]
 
@@ -12,19 +26,102 @@ CONF_TX_UART = "tx_uart"
 CONF_RX_UART = "rx_uart"
 CONF_S21_ID = "s21_id"
 CONF_DEBUG_PROTOCOL = "debug_protocol"
+CONF_METRICS = "metrics"
+CONF_BEACON = "beacon"
+CONF_HEARTBEAT_INTERVAL = "heartbeat_interval"
+CONF_TTL = "ttl"
+CONF_ROUNDS = "rounds"
+CONF_POLL_PROFILES = "poll_profiles"
+CONF_OUTDOOR_GROUP = "outdoor_group"
+CONF_PHASE_OFFSET = "phase_offset"
+CONF_CONFIRM_TIMEOUT = "confirm_timeout"
+
+
+def AUTO_LOAD():
+    """socket is only needed to send state beacons"""
+    # Runs before validation, so this looks at the raw YAML. If that isn't
+    # available, err on the side of loading it.
+    if CORE.raw_config is None:
+        return ["s21_protocol", "socket"]
+    confs = CORE.raw_config.get("daikin_s21") or []
+    if isinstance(confs, dict):
+        confs = [confs]
+    if any(isinstance(conf, dict) and CONF_BEACON in conf for conf in confs):
+        return ["s21_protocol", "socket"]
+    return ["s21_protocol"]
 
 daikin_s21_ns = cg.esphome_ns.namespace("daikin_s21")
 DaikinS21 = daikin_s21_ns.class_("DaikinS21", cg.PollingComponent)
 DaikinS21Client = daikin_s21_ns.class_("DaikinS21Client")
+SetQueryAction = daikin_s21_ns.class_("SetQueryAction", automation.Action)
+BenchmarkAction = daikin_s21_ns.class_("BenchmarkAction", automation.Action)
+S21OutdoorGroup = daikin_s21_ns.class_("S21OutdoorGroup")
+S21PollProfile = daikin_s21_ns.enum("S21PollProfile", is_class=True)
 uart_ns = cg.esphome_ns.namespace("uart")
 UARTComponent = uart_ns.class_("UARTComponent")
 
+# Must match S21_POLL_QUERIES.
+POLL_QUERIES = ["F1", "F5", "Rd", "F9", "RH", "RI", "Ra", "RL"]
+
+POLL_PROFILES = {
+    "running": S21PollProfile.Running,
+    "off": S21PollProfile.Off,
+    "transitioning": S21PollProfile.Transitioning,
+    "degraded": S21PollProfile.Degraded,
+}
+
+
+def validate_profile(value):
+    """F1 carries the climate state and can't be left out of any profile."""
+    if value.get("F1") == 0:
+        raise cv.Invalid("F1 can't be disabled")
+    return value
+
+
+# Interval in poll cycles per query, 0 to skip it.
+PROFILE_SCHEMA = cv.All(
+    cv.Schema(
+        {cv.Optional(code): cv.int_range(min=0, max=254) for code in POLL_QUERIES}
+    ),
+    validate_profile,
+)
+
 CONFIG_SCHEMA = cv.Schema(
     {
         cv.GenerateID(): cv.declare_id(DaikinS21),
         cv.Required(CONF_TX_UART): cv.use_id(UARTComponent),
         cv.Required(CONF_RX_UART): cv.use_id(UARTComponent),
         cv.Optional(CONF_DEBUG_PROTOCOL, default=False): cv.boolean,
+        cv.Optional(CONF_CONFIRM_TIMEOUT, default="5s"): cv.All(
+            cv.positive_time_period_milliseconds,
+            cv.Range(min=cv.TimePeriod(seconds=1), max=cv.TimePeriod(seconds=60)),
+        ),
+        cv.Optional(CONF_METRICS): cv.Schema(
+            {
+                cv.GenerateID(CONF_WEB_SERVER_BASE_ID): cv.use_id(
+                    web_server_base.WebServerBase
+                ),
+                cv.Optional(CONF_PATH, default="/metrics/daikin_s21"): cv.string,
+            }
+        ),
+        cv.Optional(CONF_OUTDOOR_GROUP): cv.validate_id_name,
+        cv.Optional(CONF_TIME_ID): cv.use_id(time_.RealTimeClock),
+        cv.Optional(
+            CONF_PHASE_OFFSET, default="0s"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_POLL_PROFILES): cv.Schema(
+            {cv.Optional(name): PROFILE_SCHEMA for name in POLL_PROFILES}
+        ),
+        cv.Optional(CONF_BEACON): cv.Schema(
+            {
+                cv.Optional(CONF_ADDRESS, default="239.255.21.21"): cv.ipv4address,
+                cv.Optional(CONF_PORT, default=52100): cv.port,
+                cv.Optional(
+                    CONF_HEARTBEAT_INTERVAL, default="60s"
+                ): cv.positive_time_period_milliseconds,
+                cv.Optional(CONF_TTL, default=1): cv.int_range(min=1, max=255),
+            }
+        ),
     }
 ).extend(cv.polling_component_schema("2s"))
 
@@ -35,6 +132,19 @@ S21_CLIENT_SCHEMA = cv.Schema(
 )
 
 
+async def get_outdoor_group(name):
+    """One shared S21OutdoorGroup per group name"""
+    groups = CORE.data.setdefault("daikin_s21_outdoor_groups", {})
+    if name not in groups:
+        group_id = ID(
+            f"daikin_s21_outdoor_group_{name}",
+            is_declaration=True,
+            type=S21OutdoorGroup,
+        )
+        groups[name] = cg.new_Pvariable(group_id)
+    return groups[name]
+
+
 async def to_code(config):
     """Generate code"""
     var = cg.new_Pvariable(config[CONF_ID])
@@ -43,3 +153,95 @@ async def to_code(config):
     rx_uart = await cg.get_variable(config[CONF_RX_UART])
     cg.add(var.set_uarts(tx_uart, rx_uart))
     cg.add(var.set_debug_protocol(config[CONF_DEBUG_PROTOCOL]))
+    cg.add(var.set_confirm_timeout(config[CONF_CONFIRM_TIMEOUT]))
+    cg.add(var.set_component_id(str(config[CONF_ID])))
+    if "ota" in CORE.loaded_integrations:
+        # Quiesce the bus while an OTA update is being written.
+        cg.add_define("USE_OTA_STATE_CALLBACK")
+    if CONF_METRICS in config:
+        metrics = config[CONF_METRICS]
+        base = await cg.get_variable(metrics[CONF_WEB_SERVER_BASE_ID])
+        cg.add_define("USE_DAIKIN_S21_METRICS")
+        cg.add(var.set_metrics(base, metrics[CONF_PATH], str(config[CONF_ID])))
+    if CONF_TIME_ID in config:
+        clock = await cg.get_variable(config[CONF_TIME_ID])
+        cg.add_define("USE_DAIKIN_S21_TIME_ALIGN")
+        cg.add(var.set_time_alignment(clock, config[CONF_PHASE_OFFSET]))
+    if CONF_OUTDOOR_GROUP in config:
+        group = await get_outdoor_group(config[CONF_OUTDOOR_GROUP])
+        cg.add(var.set_outdoor_group(group))
+    for name, queries in config.get(CONF_POLL_PROFILES, {}).items():
+        for code, interval in queries.items():
+            cg.add(var.set_profile_interval(POLL_PROFILES[name], code, interval))
+    if CONF_BEACON in config:
+        beacon = config[CONF_BEACON]
+        cg.add_define("USE_DAIKIN_S21_BEACON")
+        cg.add(
+            var.set_beacon(
+                str(beacon[CONF_ADDRESS]),
+                beacon[CONF_PORT],
+                beacon[CONF_HEARTBEAT_INTERVAL],
+                beacon[CONF_TTL],
+                CORE.name,
+                str(config[CONF_ID]),
+            )
+        )
+
+
+@automation.register_action(
+    "daikin_s21.benchmark",
+    BenchmarkAction,
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.use_id(DaikinS21),
+            cv.Optional(CONF_ROUNDS, default=10): cv.templatable(
+                cv.int_range(min=1, max=100)
+            ),
+        }
+    ),
+)
+async def benchmark_to_code(config, action_id, template_arg, args):
+    """Generate code for the benchmark action"""
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    rounds = await cg.templatable(config[CONF_ROUNDS], args, cg.uint8)
+    cg.add(var.set_rounds(rounds))
+    return var
+
+
+@automation.register_action(
+    "daikin_s21.set_query",
+    SetQueryAction,
+    cv.All(
+        cv.Schema(
+            {
+                cv.GenerateID(): cv.use_id(DaikinS21),
+                cv.Required(CONF_CODE): cv.templatable(cv.one_of(*POLL_QUERIES)),
+                cv.Optional(CONF_INTERVAL): cv.templatable(
+                    cv.int_range(min=1, max=255)
+                ),
+                cv.Optional(CONF_PRIORITY): cv.templatable(
+                    cv.int_range(min=0, max=255)
+                ),
+                cv.Optional(CONF_ENABLED): cv.templatable(cv.boolean),
+            }
+        ),
+        cv.has_at_least_one_key(CONF_INTERVAL, CONF_PRIORITY, CONF_ENABLED),
+    ),
+)
+async def set_query_to_code(config, action_id, template_arg, args):
+    """Generate code for the set_query action"""
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    code = await cg.templatable(config[CONF_CODE], args, cg.std_string)
+    cg.add(var.set_code(code))
+    if CONF_INTERVAL in config:
+        interval = await cg.templatable(config[CONF_INTERVAL], args, cg.uint8)
+        cg.add(var.set_interval(interval))
+    if CONF_PRIORITY in config:
+        priority = await cg.templatable(config[CONF_PRIORITY], args, cg.uint8)
+        cg.add(var.set_priority(priority))
+    if CONF_ENABLED in config:
+        enabled = await cg.templatable(config[CONF_ENABLED], args, bool)
+        cg.add(var.set_enabled(enabled))
+    return var
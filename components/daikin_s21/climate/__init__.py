@@ -2,9 +2,17 @@
 Daikin S21 Mini-Split ESPHome component config validation & code generation.
 """
 
+from esphome import automation
 import esphome.codegen as cg
 import esphome.config_validation as cv
 from esphome.components import climate, sensor
+from esphome.const import (
+    CONF_FAN_MODE,
+    CONF_ID,
+    CONF_MODE,
+    CONF_SWING_MODE,
+    CONF_TARGET_TEMPERATURE,
+)
 from .. import (
     daikin_s21_ns,
     CONF_S21_ID,
@@ -18,9 +26,12 @@ CONF_SETPOINT_INTERVAL = "setpoint_interval"
 DaikinS21Climate = daikin_s21_ns.class_(
     "DaikinS21Climate", climate.Climate, cg.PollingComponent, DaikinS21Client
 )
+SetStateAction = daikin_s21_ns.class_("SetStateAction", automation.Action)
 uart_ns = cg.esphome_ns.namespace("uart")
 UARTComponent = uart_ns.class_("UARTComponent")
 
+FAN_MODES = ["Automatic", "Silent", "1", "2", "3", "4", "5"]
+
 CONFIG_SCHEMA = cv.All(
     climate.climate_schema(DaikinS21Climate)
     .extend(
@@ -47,3 +58,48 @@ async def to_code(config):
         cg.add(var.set_room_sensor(sens))
         if CONF_SETPOINT_INTERVAL in config:
             cg.add(var.set_setpoint_interval(config[CONF_SETPOINT_INTERVAL]))
+
+
+@automation.register_action(
+    "daikin_s21.set_state",
+    SetStateAction,
+    cv.All(
+        cv.Schema(
+            {
+                cv.Required(CONF_ID): cv.use_id(DaikinS21Climate),
+                cv.Optional(CONF_MODE): cv.templatable(
+                    climate.validate_climate_mode
+                ),
+                cv.Optional(CONF_TARGET_TEMPERATURE): cv.templatable(
+                    cv.temperature
+                ),
+                cv.Optional(CONF_FAN_MODE): cv.templatable(cv.one_of(*FAN_MODES)),
+                cv.Optional(CONF_SWING_MODE): cv.templatable(
+                    climate.validate_climate_swing_mode
+                ),
+            }
+        ),
+        cv.has_at_least_one_key(
+            CONF_MODE, CONF_TARGET_TEMPERATURE, CONF_FAN_MODE, CONF_SWING_MODE
+        ),
+    ),
+)
+async def set_state_to_code(config, action_id, template_arg, args):
+    """Generate code for the set_state action"""
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    if CONF_MODE in config:
+        mode = await cg.templatable(config[CONF_MODE], args, climate.ClimateMode)
+        cg.add(var.set_mode(mode))
+    if CONF_TARGET_TEMPERATURE in config:
+        target = await cg.templatable(config[CONF_TARGET_TEMPERATURE], args, float)
+        cg.add(var.set_target_temperature(target))
+    if CONF_FAN_MODE in config:
+        fan_mode = await cg.templatable(config[CONF_FAN_MODE], args, cg.std_string)
+        cg.add(var.set_fan_mode(fan_mode))
+    if CONF_SWING_MODE in config:
+        swing_mode = await cg.templatable(
+            config[CONF_SWING_MODE], args, climate.ClimateSwingMode
+        )
+        cg.add(var.set_swing_mode(swing_mode))
+    return var
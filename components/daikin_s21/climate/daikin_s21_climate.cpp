@@ -21,6 +21,16 @@ void DaikinS21Climate::setup() {
   auto_setpoint_pref = global_preferences->make_preference<int16_t>(h + 1);
   cool_setpoint_pref = global_preferences->make_preference<int16_t>(h + 2);
   heat_setpoint_pref = global_preferences->make_preference<int16_t>(h + 3);
+  // Commands complete asynchronously; resync once the unit has confirmed,
+  // or gave up, in which case the entity falls back to the unit's state.
+  this->s21->add_on_command_callback([this]() {
+    if (!this->s21->last_command_confirmed()) {
+      ESP_LOGW(TAG, "Unit did not take %s, reverting to its state",
+               s21_command_to_code(this->s21->last_command()));
+    }
+    this->update();
+  });
+  this->align_updates(this);
 }
 
 void DaikinS21Climate::dump_config() {
@@ -321,7 +331,9 @@ void DaikinS21Climate::update() {
              this->room_sensor_degc());
     ESP_LOGD(TAG, "  Offset: %.1f", this->get_room_temp_offset());
   }
-  if (this->s21->is_ready()) {
+  // While a command is in flight the unit still reports the old state, which
+  // would briefly revert the optimistic state published by control().
+  if (this->s21->is_ready() && !this->s21->is_command_pending()) {
     if (this->s21->is_power_on()) {
       this->mode = this->d2e_climate_mode(this->s21->get_climate_mode());
       this->action = this->d2e_climate_action();
@@ -375,19 +387,8 @@ void DaikinS21Climate::control(const climate::ClimateCall &call) {
   bool set_basic = false;
 
   if (call.get_mode().has_value()) {
-    climate::ClimateMode climate_mode = call.get_mode().value();
-    if (this->mode != climate_mode) {
-      this->mode = climate_mode;
-      set_basic = true;
-      if (!call.get_target_temperature().has_value()) {
-        // If call does not include target, then try to use saved target.
-        DaikinClimateMode dmode = this->e2d_climate_mode(this->mode);
-        optional<float> sp = this->load_setpoint(dmode);
-        if (sp.has_value()) {
-          this->target_temperature = nearest_step(sp.value());
-        }
-      }
-    }
+    set_basic = this->apply_mode(call.get_mode().value(),
+                                 call.get_target_temperature().has_value());
   }
   if (call.get_target_temperature().has_value()) {
     this->target_temperature =
@@ -405,14 +406,52 @@ void DaikinS21Climate::control(const climate::ClimateCall &call) {
 
   if (call.get_swing_mode().has_value()) {
     climate::ClimateSwingMode swing_mode = call.get_swing_mode().value();
+    this->swing_mode = swing_mode;
     this->s21->set_swing_settings(this->e2d_swing_v(swing_mode),
                                   this->e2d_swing_h(swing_mode));
   }
 
-  this->update();
+  this->publish_state();
+}
+
+void DaikinS21Climate::set_state(optional<climate::ClimateMode> mode,
+                                 optional<float> target,
+                                 optional<std::string> fan_mode,
+                                 optional<climate::ClimateSwingMode> swing_mode) {
+  if (mode.has_value()) {
+    this->apply_mode(mode.value(), target.has_value());
+  }
+  if (target.has_value()) {
+    this->target_temperature = nearest_step(target.value());
+  }
+  if (fan_mode.has_value()) {
+    this->custom_fan_mode = fan_mode.value();
+  }
+  if (swing_mode.has_value()) {
+    this->swing_mode = swing_mode.value();
+  }
+  this->set_s21_climate(true);
+  this->publish_state();
+}
+
+// Returns true if the mode changed. Without an explicit target the saved
+// setpoint for the new mode is restored.
+bool DaikinS21Climate::apply_mode(climate::ClimateMode mode, bool has_target) {
+  if (this->mode == mode) {
+    return false;
+  }
+  this->mode = mode;
+  if (!has_target) {
+    DaikinClimateMode dmode = this->e2d_climate_mode(this->mode);
+    optional<float> sp = this->load_setpoint(dmode);
+    if (sp.has_value()) {
+      this->target_temperature = nearest_step(sp.value());
+    }
+  }
+  return true;
 }
 
-void DaikinS21Climate::set_s21_climate() {
+void DaikinS21Climate::set_s21_climate(bool with_swing) {
   this->expected_s21_setpoint =
       this->calc_s21_setpoint(this->target_temperature);
   ESP_LOGI(TAG, "Controlling S21 climate:");
@@ -420,10 +459,21 @@ void DaikinS21Climate::set_s21_climate() {
   ESP_LOGI(TAG, "  Setpoint: %.1f (s21: %.1f)", this->target_temperature,
            this->expected_s21_setpoint);
   ESP_LOGI(TAG, "  Fan: %s", this->custom_fan_mode.value().c_str());
-  this->s21->set_daikin_climate_settings(
-      this->mode != climate::CLIMATE_MODE_OFF,
-      this->e2d_climate_mode(this->mode), this->expected_s21_setpoint,
-      this->e2d_fan_mode(this->custom_fan_mode.value()));
+  if (with_swing) {
+    ESP_LOGI(TAG, "  Swing: %s",
+             climate::climate_swing_mode_to_string(this->swing_mode));
+    this->s21->set_state(this->mode != climate::CLIMATE_MODE_OFF,
+                         this->e2d_climate_mode(this->mode),
+                         this->expected_s21_setpoint,
+                         this->e2d_fan_mode(this->custom_fan_mode.value()),
+                         this->e2d_swing_v(this->swing_mode),
+                         this->e2d_swing_h(this->swing_mode));
+  } else {
+    this->s21->set_daikin_climate_settings(
+        this->mode != climate::CLIMATE_MODE_OFF,
+        this->e2d_climate_mode(this->mode), this->expected_s21_setpoint,
+        this->e2d_fan_mode(this->custom_fan_mode.value()));
+  }
   // HVAC unit seems to take a few seconds to begin reporting mode and setpoint
   // changes back to the controller, so when modifying settings, setpoint checks
   // are skipped to avoid unexpected setpoint updates, especially when changing
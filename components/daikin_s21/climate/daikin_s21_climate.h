@@ -4,6 +4,7 @@
 #include "esphome/components/climate/climate.h"
 #include "esphome/components/sensor/sensor.h"
 #include "esphome/components/uart/uart.h"
+#include "esphome/core/automation.h"
 #include "esphome/core/component.h"
 #include "esphome/core/preferences.h"
 #include "../s21.h"
@@ -31,6 +32,11 @@ class DaikinS21Climate : public climate::Climate,
   void update() override;
   void dump_config() override;
   void control(const climate::ClimateCall &call) override;
+  // Applies whatever is given in one D1 + D5 exchange; unset values keep
+  // their current state.
+  void set_state(optional<climate::ClimateMode> mode, optional<float> target,
+                 optional<std::string> fan_mode,
+                 optional<climate::ClimateSwingMode> swing_mode);
 
   void set_room_sensor(sensor::Sensor *sensor) { this->room_sensor_ = sensor; }
   void set_setpoint_interval(uint16_t seconds) {
@@ -73,7 +79,25 @@ class DaikinS21Climate : public climate::Climate,
   void save_setpoint(float value);
   optional<float> load_setpoint(ESPPreferenceObject &pref);
   optional<float> load_setpoint(DaikinClimateMode mode);
-  void set_s21_climate();
+  bool apply_mode(climate::ClimateMode mode, bool has_target);
+  void set_s21_climate(bool with_swing = false);
+};
+
+template<typename... Ts>
+class SetStateAction : public Action<Ts...>,
+                       public Parented<DaikinS21Climate> {
+ public:
+  TEMPLATABLE_VALUE(climate::ClimateMode, mode)
+  TEMPLATABLE_VALUE(float, target_temperature)
+  TEMPLATABLE_VALUE(std::string, fan_mode)
+  TEMPLATABLE_VALUE(climate::ClimateSwingMode, swing_mode)
+
+  void play(Ts... x) override {
+    this->parent_->set_state(this->mode_.optional_value(x...),
+                             this->target_temperature_.optional_value(x...),
+                             this->fan_mode_.optional_value(x...),
+                             this->swing_mode_.optional_value(x...));
+  }
 };
 
 }  // namespace daikin_s21
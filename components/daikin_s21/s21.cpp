@@ -1,20 +1,108 @@
+#include <algorithm>
 #include <cinttypes>
+#include <memory>
 #include "s21.h"
+#include "s21_metrics.h"
+#if defined(USE_OTA) && defined(USE_OTA_STATE_CALLBACK)
+#include "esphome/components/ota/ota_backend.h"
+#endif
 
 using namespace esphome;
+using namespace esphome::s21_protocol;
 
 namespace esphome {
 namespace daikin_s21 {
 
-#define STX 2
-#define ETX 3
-#define ACK 6
-#define NAK 21
-
-#define S21_RESPONSE_TIMEOUT 250
+#define S21_WARNING_SUMMARY_INTERVAL 60000
+#define S21_ACK_TIMEOUT 100
+// 2400 baud, 8 data bits, parity and 2 stop bits: 12 bits per byte
+#define S21_BYTE_TIME_MS 5
+#define S21_CONFIRM_INTERVAL 250
+// Command delivery: attempts (send plus confirm), the first retry delay
+// which doubles each time, and the overall deadline from the request.
+#define S21_COMMAND_ATTEMPTS 4
+#define S21_RETRY_BACKOFF 500
+#define S21_COMMAND_DEADLINE 15000
+// Bytes consumed waiting for one response before giving up early. A valid
+// frame is at most S21_MAX_ENCODED_SIZE, so this only trips on line noise
+// and bounds the work done per transaction.
+#define S21_MAX_RESPONSE_BYTES (2 * S21_MAX_ENCODED_SIZE)
+// Stray bytes per transaction kept in the trace, so a noise burst doesn't
+// flush everything else out of it.
+#define S21_TRACE_JUNK_BYTES 4
+// Consecutive NAKs after which a poll query is taken to be unsupported.
+#define S21_UNSUPPORTED_NAKS 3
+// Bump when S21ProtocolInfo or S21_POLL_QUERIES change, so stale cached
+// protocol info is ignored.
+#define S21_PROTOCOL_INFO_VERSION 2
+#define S21_QUERY_PLAN_VERSION 1
+// How long after a power or mode change the transitioning profile is kept.
+#define S21_TRANSITION_MS 60000
+// Quiet time between transactions, learned per unit: start conservative,
+// shave a step off after a run of clean transactions, back off on a
+// timeout or garbled reply.
+#define S21_GAP_INITIAL_MS 20
+#define S21_GAP_MAX_MS 100
+#define S21_GAP_STEP_MS 5
+#define S21_GAP_BACKOFF_MS 20
+#define S21_GAP_PROBE_AFTER 32
+#define S21_GAP_RETRY_FACTOR 16
+// Age after which any outdoor group member polls the shared readings.
+#define S21_GROUP_STALE_MS 30000
 
 static const char *const TAG = "daikin_s21";
 
+const char *s21_poll_profile_to_string(S21PollProfile profile) {
+  switch (profile) {
+    case S21PollProfile::Running:
+      return "running";
+    case S21PollProfile::Off:
+      return "off";
+    case S21PollProfile::Transitioning:
+      return "transitioning";
+    case S21PollProfile::Degraded:
+      return "degraded";
+    default:
+      return "UNKNOWN";
+  }
+}
+
+const char *s21_result_to_string(S21Result result) {
+  switch (result) {
+    case S21Result::Ok:
+      return "OK";
+    case S21Result::Nak:
+      return "NAK";
+    case S21Result::Timeout:
+      return "timeout";
+    case S21Result::Error:
+      return "error";
+    case S21Result::DecodeError:
+      return "decode error";
+    default:
+      return "UNKNOWN";
+  }
+}
+
+const char *s21_command_to_code(S21Command cmd) {
+  switch (cmd) {
+    case S21Command::Climate:
+      return "D1";
+    case S21Command::Swing:
+      return "D5";
+    default:
+      return "??";
+  }
+}
+
+const S21ModelQuirks *s21_find_model_quirks(const char *model) {
+  const S21ModelQuirks *q = S21_MODEL_QUIRKS;
+  while (q->model != nullptr && strcmp(q->model, model) != 0) {
+    q++;
+  }
+  return q;
+}
+
 std::string daikin_climate_mode_to_string(DaikinClimateMode mode) {
   switch (mode) {
     case DaikinClimateMode::Disabled:
@@ -55,44 +143,115 @@ std::string daikin_fan_mode_to_string(DaikinFanMode mode) {
   }
 }
 
-uint8_t s21_checksum(uint8_t *bytes, uint8_t len) {
-  uint8_t checksum = 0;
-  for (uint8_t i = 0; i < len; i++) {
-    checksum += bytes[i];
+void DaikinS21::setup() {
+  this->stats.frame_gap_ms = S21_GAP_INITIAL_MS;
+  this->quirks = s21_find_model_quirks("");
+  this->protocol_pref = global_preferences->make_preference<S21ProtocolInfo>(
+      fnv1_hash(std::string("daikin_s21_protocol/") + this->component_id) +
+      S21_PROTOCOL_INFO_VERSION);
+  if (this->protocol_pref.load(&this->protocol)) {
+    this->negotiated = true;
+    this->quirks = s21_find_model_quirks(this->protocol.model);
+    this->select_plan();
+    ESP_LOGD(TAG, "Using cached protocol info");
   }
-  return checksum;
-}
-
-uint8_t s21_checksum(std::vector<uint8_t> bytes) {
-  return s21_checksum(&bytes[0], bytes.size());
-}
-
-int16_t bytes_to_num(uint8_t *bytes, size_t len) {
-  // <ones><tens><hundreds><neg/pos>
-  int16_t val = 0;
-  val = bytes[0] - '0';
-  val += (bytes[1] - '0') * 10;
-  val += (bytes[2] - '0') * 100;
-  if (len > 3 && bytes[3] == '-')
-    val *= -1;
-  return val;
+  this->load_query_plan();
+#if defined(USE_OTA) && defined(USE_OTA_STATE_CALLBACK)
+  // Keep the bus quiet for the duration of an OTA, so no transaction is
+  // left half done. On success the device reboots.
+  ota::get_global_ota_callback()->add_on_state_callback(
+      [this](ota::OTAState state, float progress, uint8_t error,
+             ota::OTAComponent *comp) {
+        if (state == ota::OTA_STARTED) {
+          this->suspend();
+        } else if (state == ota::OTA_ABORT || state == ota::OTA_ERROR) {
+          this->resume();
+        }
+      });
+#endif
+#ifdef USE_DAIKIN_S21_METRICS
+  if (this->metrics_base != nullptr) {
+    this->metrics_base->init();
+    this->metrics_base->add_handler(new DaikinS21MetricsHandler(
+        this, this->metrics_path, this->metrics_unit));
+  }
+#endif
+#ifdef USE_DAIKIN_S21_BEACON
+  this->beacon_socket = socket::socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+  if (this->beacon_socket == nullptr) {
+    ESP_LOGW(TAG, "Could not create beacon socket");
+    return;
+  }
+  this->beacon_socket->setblocking(false);
+  this->beacon_socket->setsockopt(IPPROTO_IP, IP_MULTICAST_TTL,
+                                  &this->beacon_ttl, sizeof(this->beacon_ttl));
+  this->beacon_addrlen = socket::set_sockaddr(
+      (struct sockaddr *) &this->beacon_addr, sizeof(this->beacon_addr),
+      this->beacon_address, this->beacon_port);
+#endif
 }
 
-int16_t bytes_to_num(std::vector<uint8_t> &bytes) {
-  return bytes_to_num(&bytes[0], bytes.size());
+#ifdef USE_DAIKIN_S21_BEACON
+void DaikinS21::set_beacon(const std::string &address, uint16_t port,
+                           uint32_t heartbeat_ms, uint8_t ttl,
+                           const char *node, const char *unit) {
+  this->beacon_address = address;
+  this->beacon_port = port;
+  this->beacon_heartbeat_ms = heartbeat_ms;
+  this->beacon_ttl = ttl;
+  this->beacon_node = node;
+  this->beacon_node_id = fnv1_hash(std::string(node) + "/" + unit);
 }
 
-int16_t temp_bytes_to_c10(uint8_t *bytes) { return bytes_to_num(bytes, 4); }
-
-int16_t temp_bytes_to_c10(std::vector<uint8_t> &bytes) {
-  return temp_bytes_to_c10(&bytes[0]);
-}
+// Multicast the state snapshot when it changed, or as a heartbeat.
+void DaikinS21::send_beacon() {
+  if (this->beacon_socket == nullptr) {
+    return;
+  }
+  S21Beacon b;
+  b.flags = (this->power_on ? S21_BEACON_FLAG_POWER : 0) |
+            (this->idle ? S21_BEACON_FLAG_IDLE : 0) |
+            (this->swing_v ? S21_BEACON_FLAG_SWING_V : 0) |
+            (this->swing_h ? S21_BEACON_FLAG_SWING_H : 0) |
+            (this->ready ? S21_BEACON_FLAG_READY : 0);
+  b.mode = (uint8_t) this->mode;
+  b.fan = (uint8_t) this->fan;
+  b.node_id = this->beacon_node_id;
+  b.setpoint = this->setpoint;
+  b.temp_inside = this->temp_inside;
+  b.temp_outside = this->temp_outside;
+  b.temp_coil = this->temp_coil;
+  b.fan_rpm = this->fan_rpm;
+  b.transactions = this->stats.transactions;
+  b.naks = this->stats.naks;
+  b.timeouts = this->stats.timeouts;
+  b.checksum_errors = this->stats.checksum_errors;
+  strncpy(b.name, this->beacon_node, S21_BEACON_NAME_SIZE);
 
-int16_t temp_f9_byte_to_c10(uint8_t *bytes) { return (*bytes / 2 - 64) * 10; }
+  uint32_t now = millis();
+  bool changed =
+      this->last_beacon.seq == 0 || b.state_differs(this->last_beacon);
+  if (!changed && now - this->last_beacon_ms < this->beacon_heartbeat_ms) {
+    return;
+  }
+  if (!changed) {
+    b.flags |= S21_BEACON_FLAG_HEARTBEAT;
+  }
+  b.seq = this->last_beacon.seq + 1;
+  b.uptime_s = now / 1000;
 
-uint8_t c10_to_setpoint_byte(int16_t setpoint) {
-  return (setpoint + 3) / 5 + 28;
+  uint8_t buf[S21_BEACON_SIZE];
+  encode_s21_beacon(b, buf);
+  ssize_t sent = this->beacon_socket->sendto(
+      buf, sizeof(buf), 0, (struct sockaddr *) &this->beacon_addr,
+      this->beacon_addrlen);
+  if (sent != sizeof(buf)) {
+    ESP_LOGV(TAG, "Beacon send failed (%d)", (int) sent);
+  }
+  this->last_beacon = b;
+  this->last_beacon_ms = now;
 }
+#endif
 
 void DaikinS21::set_uarts(uart::UARTComponent *tx, uart::UARTComponent *rx) {
   this->tx_uart = tx;
@@ -139,179 +298,572 @@ void DaikinS21::check_uart_settings() {
 void DaikinS21::dump_config() {
   ESP_LOGCONFIG(TAG, "DaikinS21:");
   ESP_LOGCONFIG(TAG, "  Update interval: %" PRIu32, this->get_update_interval());
+  if (this->negotiated) {
+    this->log_protocol_info();
+  }
+  ESP_LOGCONFIG(TAG, "  Poll profile: %s",
+                s21_poll_profile_to_string(this->profile));
+  ESP_LOGCONFIG(TAG, "  Frame gap: %ums", this->stats.frame_gap_ms);
+  ESP_LOGCONFIG(TAG, "  Confirm timeout: %" PRIu32 "ms",
+                this->confirm_timeout);
+#ifdef USE_DAIKIN_S21_TIME_ALIGN
+  ESP_LOGCONFIG(TAG, "  Clock aligned: %s (phase offset %" PRIu32 "ms)",
+                YESNO(this->time_aligned), this->phase_offset_ms);
+#endif
+  if (this->outdoor_group != nullptr) {
+    ESP_LOGCONFIG(TAG, "  Outdoor group: %u members",
+                  (unsigned) this->outdoor_group->size());
+  }
+#ifdef USE_DAIKIN_S21_METRICS
+  if (this->metrics_base != nullptr) {
+    ESP_LOGCONFIG(TAG, "  Metrics path: %s", this->metrics_path);
+  }
+#endif
+#ifdef USE_DAIKIN_S21_BEACON
+  ESP_LOGCONFIG(TAG, "  Beacon: %s:%u (heartbeat %" PRIu32 "ms)",
+                this->beacon_address.c_str(), this->beacon_port,
+                this->beacon_heartbeat_ms);
+#endif
   this->check_uart_settings();
 }
 
-// Adapated from ESPHome UART debugger
-std::string hex_repr(uint8_t *bytes, size_t len) {
-  std::string res;
-  char buf[5];
-  for (size_t i = 0; i < len; i++) {
-    if (i > 0)
-      res += ':';
-    sprintf(buf, "%02X", bytes[i]);
-    res += buf;
-  }
-  return res;
-}
-
-// Adapated from ESPHome UART debugger
-std::string str_repr(uint8_t *bytes, size_t len) {
-  std::string res;
-  char buf[5];
-  for (size_t i = 0; i < len; i++) {
-    if (bytes[i] == 7) {
-      res += "\\a";
-    } else if (bytes[i] == 8) {
-      res += "\\b";
-    } else if (bytes[i] == 9) {
-      res += "\\t";
-    } else if (bytes[i] == 10) {
-      res += "\\n";
-    } else if (bytes[i] == 11) {
-      res += "\\v";
-    } else if (bytes[i] == 12) {
-      res += "\\f";
-    } else if (bytes[i] == 13) {
-      res += "\\r";
-    } else if (bytes[i] == 27) {
-      res += "\\e";
-    } else if (bytes[i] == 34) {
-      res += "\\\"";
-    } else if (bytes[i] == 39) {
-      res += "\\'";
-    } else if (bytes[i] == 92) {
-      res += "\\\\";
-    } else if (bytes[i] < 32 || bytes[i] > 127) {
-      sprintf(buf, "\\x%02X", bytes[i]);
-      res += buf;
-    } else {
-      res += bytes[i];
+void DaikinS21::write_frame(const uint8_t *frame, size_t len) {
+  uint8_t buf[S21_MAX_ENCODED_SIZE];
+  this->trace(S21TraceEvent::TxFrame, frame, len);
+  size_t encoded = encode_frame(frame, len, buf);
+  // No flush: the UART driver drains its TX buffer on its own and the ACK
+  // timeout allows for the time on the wire.
+  this->tx_uart->write_array(buf, encoded);
+}
+
+void DaikinS21::record_transaction(uint32_t start) {
+  uint32_t elapsed = millis() - start;
+  this->stats.transactions++;
+  s21_histogram_add(S21_LATENCY_BUCKETS_MS, S21_LATENCY_BUCKET_COUNT,
+                    this->stats.latency_buckets, &this->stats.latency_sum_ms,
+                    elapsed);
+  this->stats.bus_busy_ms += elapsed;
+}
+
+// NAKs are a normal answer (unsupported query) and don't count either way.
+// A run of failures backs off only once: an unplugged unit says nothing
+// about the gap it needs. Going back down to a gap that has failed before
+// takes a much longer clean run, so a marginal unit isn't hit every time.
+void DaikinS21::learn_frame_gap(S21Result result) {
+  uint16_t &gap = this->stats.frame_gap_ms;
+  if (result == S21Result::Timeout || result == S21Result::Error) {
+    if (this->gap_clean > 0 && gap < S21_GAP_MAX_MS) {
+      this->gap_failed = std::max(this->gap_failed, gap);
+      gap = std::min<uint16_t>(gap + S21_GAP_BACKOFF_MS, S21_GAP_MAX_MS);
+      ESP_LOGD(TAG, "Frame gap backed off to %ums", gap);
+    }
+    this->gap_clean = 0;
+    return;
+  }
+  if (result != S21Result::Ok || gap < S21_GAP_STEP_MS) {
+    return;
+  }
+  uint16_t needed = gap - S21_GAP_STEP_MS <= this->gap_failed
+                        ? S21_GAP_PROBE_AFTER * S21_GAP_RETRY_FACTOR
+                        : S21_GAP_PROBE_AFTER;
+  if (++this->gap_clean >= needed) {
+    this->gap_clean = 1;
+    gap -= S21_GAP_STEP_MS;
+    if (gap < this->gap_failed) {
+      // Held up long enough; give the old failure less weight.
+      this->gap_failed = gap;
     }
+    ESP_LOGV(TAG, "Probing frame gap %ums", gap);
   }
-  return res;
 }
 
-std::string str_repr(std::vector<uint8_t> &bytes) {
-  return str_repr(&bytes[0], bytes.size());
+bool DaikinS21::enqueue(const uint8_t *frame, size_t len, size_t code_len,
+                        bool is_query, S21Callback &&done) {
+  if (this->queue_len == S21_QUEUE_SIZE || len > S21_MAX_REQUEST_SIZE) {
+    ESP_LOGW(TAG, "Cannot queue %s", str_repr(frame, len).c_str());
+    return false;
+  }
+  S21Transaction &txn =
+      this->queue[(this->queue_head + this->queue_len) % S21_QUEUE_SIZE];
+  if (len > 0)
+    memcpy(txn.frame, frame, len);
+  txn.len = len;
+  txn.code_len = code_len;
+  txn.is_query = is_query;
+  txn.done = std::move(done);
+  this->queue_len++;
+  return true;
 }
 
-bool DaikinS21::read_frame(std::vector<uint8_t> &payload) {
-  uint8_t byte;
-  std::vector<uint8_t> bytes;
-  uint32_t start = millis();
-  bool reading = false;
-  while (true) {
-    if (millis() - start > S21_RESPONSE_TIMEOUT) {
-      ESP_LOGW(TAG, "Timeout waiting for frame");
-      return false;
-    }
-    while (this->rx_uart->available()) {
-      this->rx_uart->read_byte(&byte);
-      if (byte == ACK) {
-        ESP_LOGW(TAG, "Unexpected ACK waiting to read start of frame");
-        continue;
-      } else if (!reading && byte != STX) {
-        ESP_LOGW(TAG, "Unexpected byte waiting to read start of frame: %x",
-                 byte);
-        continue;
-      } else if (byte == STX) {
-        reading = true;
-        continue;
-      }
-      if (byte == ETX) {
-        reading = false;
-        uint8_t frame_csum = bytes[bytes.size() - 1];
-        bytes.pop_back();
-        uint8_t calc_csum = s21_checksum(bytes);
-        if (calc_csum != frame_csum) {
-          // This sometimes happens with G9 reply, no idea why
-          if (bytes[0] == 0x47 && bytes[1] == 0x39) {
-            calc_csum += 2;
-          }
-          if (calc_csum != frame_csum) {
-            ESP_LOGW(TAG, "Checksum mismatch: %x (frame) != %x (calc from %s)",
-            frame_csum, calc_csum,
-            hex_repr(&bytes[0], bytes.size()).c_str());
-            return false;
-          }
-        }
-        break;
-      }
-      bytes.push_back(byte);
-    }
-    if (bytes.size() && !reading)
+bool DaikinS21::query(const std::string &code, S21Callback done) {
+  return this->enqueue((const uint8_t *) code.data(), code.size(), code.size(),
+                       true, std::move(done));
+}
+
+bool DaikinS21::sync(std::function<void()> &&done) {
+  return this->enqueue(nullptr, 0, 0, false, [done](S21Result) { done(); });
+}
+
+void DaikinS21::loop() {
+  // Driven from here rather than the poll cycle, so the summary still comes
+  // out while negotiation keeps failing and no cycle ever completes.
+  this->log_warning_summary();
+#ifdef USE_DAIKIN_S21_TIME_ALIGN
+  if (this->clock != nullptr) {
+    this->track_clock();
+  }
+#endif
+  switch (this->state) {
+    case EngineState::WaitAck:
+      this->handle_ack();
+      break;
+    case EngineState::WaitFrame:
+      this->handle_frame();
+      break;
+    default:
       break;
-    yield();
   }
-  payload.assign(bytes.begin(), bytes.end());
-  return true;
+  // Start the next transaction straight away rather than on the next loop,
+  // once the unit has had its quiet time. Sync points don't touch the bus.
+  while (this->state == EngineState::Idle && this->queue_len > 0 &&
+         !this->suspended) {
+    if (this->queue[this->queue_head].len > 0 &&
+        millis() - this->txn_end < this->stats.frame_gap_ms) {
+      break;
+    }
+    this->start_transaction();
+  }
+}
+
+#ifdef USE_DAIKIN_S21_TIME_ALIGN
+// Watches for the wall-clock second to tick over. The first tick seen with
+// a valid clock hands polling over from the free-running poller to
+// wall-clock aligned cycles.
+void DaikinS21::track_clock() {
+  time_t now = this->clock->timestamp_now();
+  if (now == this->clock_second) {
+    return;
+  }
+  bool was_valid = this->clock_valid;
+  this->clock_second = now;
+  this->clock_second_ms = millis();
+  this->clock_valid = this->clock->now().is_valid();
+  // Only a tick between two valid seconds marks a real second boundary.
+  if (!this->time_aligned && was_valid && this->clock_valid) {
+    this->time_aligned = true;
+    this->stop_poller();
+    ESP_LOGI(TAG, "Aligning poll cycles to the clock");
+    this->schedule_aligned_cycle();
+  }
 }
 
-void DaikinS21::write_frame(std::vector<uint8_t> frame) {
-  this->tx_uart->write_byte(STX);
-  this->tx_uart->write_array(frame);
-  this->tx_uart->write_byte(s21_checksum(&frame[0], frame.size()));
-  this->tx_uart->write_byte(ETX);
-  this->tx_uart->flush();
+uint64_t DaikinS21::wall_ms() {
+  return (uint64_t) this->clock_second * 1000 +
+         (millis() - this->clock_second_ms);
 }
 
-bool DaikinS21::s21_query(std::vector<uint8_t> code) {
-  std::string c;
-  for (size_t i = 0; i < code.size(); i++) {
-    c += code[i];
+// Time until the next wall-clock cycle boundary at least min_ms away.
+uint32_t DaikinS21::ms_to_aligned_cycle(uint32_t min_ms) {
+  uint32_t interval = this->get_update_interval();
+  uint64_t now_ms = this->wall_ms() + min_ms;
+  uint32_t since = (now_ms + interval - this->phase_offset_ms % interval) %
+                   interval;
+  return min_ms + (interval - since) % interval;
+}
+
+void DaikinS21::schedule_aligned_cycle() {
+  // Half an interval of slack so a timer firing a little early at one
+  // boundary doesn't schedule the same boundary again.
+  uint32_t delay = this->ms_to_aligned_cycle(this->get_update_interval() / 2);
+  this->next_boundary_ms = this->wall_ms() + delay;
+  this->set_timeout("aligned_cycle", delay, [this]() {
+    if (!this->cycle_active) {
+      this->cycle_boundary_ms = this->next_boundary_ms;
+    }
+    this->update();
+    this->schedule_aligned_cycle();
+  });
+}
+
+void DaikinS21Client::align_updates(PollingComponent *client) {
+  this->s21->add_on_cycle_callback([this, client]() {
+    if (!this->s21->is_time_aligned()) {
+      return;
+    }
+    uint64_t slot = this->s21->get_cycle_slot(client->get_update_interval());
+    if (!this->updates_aligned) {
+      // The poller published recently; start with the next slot.
+      this->updates_aligned = true;
+      this->update_slot = slot;
+      client->stop_poller();
+    }
+    if (slot != this->update_slot) {
+      this->update_slot = slot;
+      client->update();
+    }
+  });
+}
+#endif
+
+void DaikinS21::start_transaction() {
+  S21Transaction &txn = this->queue[this->queue_head];
+  if (txn.len == 0) {
+    this->finish_transaction(S21Result::Ok);
+    return;
   }
-  this->write_frame(code);
+  // Anything still in the RX buffer is a late reply to an earlier request
+  // and would otherwise be mistaken for this one's ACK.
+  uint8_t byte;
+  this->junk_bytes = 0;
+  while (this->rx_uart->available() &&
+         this->junk_bytes < S21_MAX_RESPONSE_BYTES) {
+    this->rx_uart->read_byte(&byte);
+    this->note_warning(S21Warning::UnexpectedByte);
+    this->trace_junk(byte);
+  }
+  this->high_freq.start();
+  this->trace_point(S21TracePoint::TxStart);
+  this->txn_start = millis();
+  this->write_frame(txn.frame, txn.len);
+  this->trace_point(S21TracePoint::TxEnd);
+  this->state_start = millis();
+  this->state = EngineState::WaitAck;
+}
+
+void DaikinS21::finish_transaction(S21Result result) {
+  S21Transaction &txn = this->queue[this->queue_head];
+  S21Callback done = std::move(txn.done);
+  txn.done = nullptr;
+  if (txn.len > 0) {
+    this->trace_point(S21TracePoint::Done);
+    this->record_transaction(this->txn_start);
+    // A NAK is a well-formed answer; anything else means the link is bad.
+    bool failed = result == S21Result::Timeout || result == S21Result::Error;
+    if (failed) {
+      this->cycle_link_ok = false;
+    }
+    if (failed && !this->link_faulted) {
+      this->link_faulted = true;
+      this->fault_start = this->txn_start;
+    }
+    this->learn_frame_gap(result);
+    this->txn_end = millis();
+  }
+  this->queue_head = (this->queue_head + 1) % S21_QUEUE_SIZE;
+  this->queue_len--;
+  this->state = EngineState::Idle;
+  if (this->queue_len == 0)
+    this->high_freq.stop();
+  // May queue further transactions.
+  if (done)
+    done(result);
+}
 
+void DaikinS21::handle_ack() {
+  S21Transaction &txn = this->queue[this->queue_head];
   uint8_t byte;
-  if (!this->rx_uart->read_byte(&byte)) {
-    ESP_LOGW(TAG, "Timeout waiting for %s response", c.c_str());
-    return false;
+  if (!this->rx_uart->available()) {
+    uint32_t timeout = S21_ACK_TIMEOUT + (txn.len + 3) * S21_BYTE_TIME_MS;
+    if (millis() - this->state_start > timeout) {
+      if (this->note_warning(S21Warning::AckTimeout)) {
+        ESP_LOGW(TAG, "Timeout waiting for ACK to %s",
+                 str_repr(txn.frame, txn.len).c_str());
+      }
+      this->trace(S21TraceEvent::Timeout);
+      this->stats.timeouts++;
+      this->finish_transaction(S21Result::Timeout);
+    }
+    return;
   }
+  this->rx_uart->read_byte(&byte);
+  this->trace_point(S21TracePoint::Ack);
   if (byte == NAK) {
-    ESP_LOGD(TAG, "NAK from S21 for %s query", c.c_str());
-    return false;
+    if (txn.is_query) {
+      ESP_LOGD(TAG, "NAK from S21 for %s query",
+               str_repr(txn.frame, txn.len).c_str());
+    } else if (this->note_warning(S21Warning::Nak)) {
+      ESP_LOGW(TAG, "Got NAK for frame: %s",
+               str_repr(txn.frame, txn.len).c_str());
+    }
+    this->trace(S21TraceEvent::Nak);
+    this->stats.naks++;
+    this->finish_transaction(S21Result::Nak);
+    return;
   }
   if (byte != ACK) {
-    ESP_LOGW(TAG, "No ACK from S21 for %s query", c.c_str());
-    return false;
+    if (this->note_warning(S21Warning::NoAck)) {
+      ESP_LOGW(TAG, "No ACK from S21 for %s: %s",
+               str_repr(txn.frame, txn.len).c_str(),
+               str_repr(&byte, 1).c_str());
+    }
+    this->trace(S21TraceEvent::UnexpectedByte, &byte, 1);
+    this->finish_transaction(S21Result::Error);
+    return;
   }
+  this->trace(S21TraceEvent::Ack);
+  if (!txn.is_query) {
+    if (txn.frame[0] == 'D' && txn.frame[1] == '1') {
+      this->stats.d1_writes++;
+    }
+    this->finish_transaction(S21Result::Ok);
+    return;
+  }
+  this->assembler.reset();
+  this->rx_bytes = 0;
+#ifdef S21_DIFFERENTIAL
+  this->diff_rx.clear();
+#endif
+  this->state = EngineState::WaitFrame;
+  this->state_start = millis();
+  this->handle_frame();
+}
 
-  std::vector<uint8_t> frame;
-  if (!this->read_frame(frame)) {
-    ESP_LOGW(TAG, "Failed reading %s response frame", c.c_str());
-    return false;
+void DaikinS21::handle_frame() {
+  S21Transaction &txn = this->queue[this->queue_head];
+  FrameResult result = FrameResult::Pending;
+  uint8_t byte;
+  while (result != FrameResult::Frame &&
+         result != FrameResult::ChecksumError && this->rx_uart->available()) {
+    if (this->rx_bytes >= S21_MAX_RESPONSE_BYTES) {
+      if (this->note_warning(S21Warning::LineNoise)) {
+        ESP_LOGW(TAG, "No %s response frame in %u bytes, giving up",
+                 str_repr(txn.frame, txn.len).c_str(),
+                 (unsigned) S21_MAX_RESPONSE_BYTES);
+      }
+      this->finish_transaction(S21Result::Error);
+      return;
+    }
+    this->rx_uart->read_byte(&byte);
+    this->rx_bytes++;
+#ifdef S21_DIFFERENTIAL
+    this->diff_rx.push_back(byte);
+#endif
+    result = this->assembler.feed(byte);
+    if (result == FrameResult::Pending && byte == STX) {
+      this->trace_point(S21TracePoint::RxStart);
+    } else if (result == FrameResult::Frame ||
+               result == FrameResult::ChecksumError) {
+      this->trace_point(S21TracePoint::Etx);
+    } else if (result == FrameResult::UnexpectedAck) {
+      if (this->note_warning(S21Warning::UnexpectedAck)) {
+        ESP_LOGW(TAG, "Unexpected ACK waiting to read start of frame");
+      }
+      this->trace(S21TraceEvent::UnexpectedAck);
+    } else if (result == FrameResult::UnexpectedByte) {
+      if (this->note_warning(S21Warning::UnexpectedByte)) {
+        ESP_LOGW(TAG, "Unexpected byte waiting to read start of frame: %x",
+                 byte);
+      }
+      this->trace_junk(byte);
+    } else if (result == FrameResult::Overflow) {
+      if (this->note_warning(S21Warning::FrameOverflow)) {
+        ESP_LOGW(TAG, "Frame longer than %u bytes discarded",
+                 (unsigned) S21_MAX_FRAME_SIZE);
+      }
+      this->trace(S21TraceEvent::UnexpectedByte);
+    }
+  }
+
+  if (result == FrameResult::Pending || result == FrameResult::Overflow ||
+      result == FrameResult::UnexpectedAck ||
+      result == FrameResult::UnexpectedByte) {
+    uint32_t timeout = this->quirks->response_timeout > 0
+                           ? this->quirks->response_timeout
+                           : S21_RESPONSE_TIMEOUT;
+    if (millis() - this->state_start > timeout) {
+      if (this->note_warning(S21Warning::FrameTimeout)) {
+        ESP_LOGW(TAG, "Timeout waiting for %s response frame",
+                 str_repr(txn.frame, txn.len).c_str());
+      }
+      this->trace(S21TraceEvent::Timeout, this->assembler.data(),
+                  this->assembler.is_reading() ? this->assembler.size() : 0);
+      this->stats.timeouts++;
+      this->finish_transaction(S21Result::Timeout);
+    }
+    return;
   }
 
+  const uint8_t *bytes = this->assembler.data();
+  size_t len = this->assembler.size();
+#ifdef S21_DIFFERENTIAL
+  this->check_frame(result);
+#endif
+  if (result == FrameResult::ChecksumError) {
+    uint8_t frame_csum = this->assembler.received_checksum();
+    uint8_t calc_csum = this->assembler.computed_checksum();
+    if (len >= 2 && bytes[0] == this->quirks->checksum_code[0] &&
+        bytes[1] == this->quirks->checksum_code[1]) {
+      calc_csum += this->quirks->checksum_offset;
+    }
+    // An empty frame has no checksum to compare.
+    if (len == 0 || calc_csum != frame_csum) {
+      if (this->note_warning(S21Warning::ChecksumMismatch)) {
+        ESP_LOGW(TAG, "Checksum mismatch: %x (frame) != %x (calc from %s)",
+                 frame_csum, calc_csum, hex_repr(bytes, len).c_str());
+      }
+      this->trace(S21TraceEvent::ChecksumError, bytes, len);
+      this->stats.checksum_errors++;
+      this->finish_transaction(S21Result::Error);
+      return;
+    }
+  }
+  this->trace(S21TraceEvent::RxFrame, bytes, len);
   this->tx_uart->write_byte(ACK);
 
-  std::vector<uint8_t> rcode;
+  size_t code_len = len < txn.code_len ? len : txn.code_len;
+  std::vector<uint8_t> rcode(bytes, bytes + code_len);
+  std::vector<uint8_t> payload(bytes + code_len, bytes + len);
+#ifdef S21_DIFFERENTIAL
+  bool parsed = this->check_decode(rcode, payload);
+#else
+  bool parsed = this->parse_response(rcode, payload);
+#endif
+  this->trace_point(S21TracePoint::Decode);
+  if (!parsed) {
+    this->stats.decode_errors++;
+  }
+  this->finish_transaction(parsed ? S21Result::Ok : S21Result::DecodeError);
+}
+
+#ifdef S21_DIFFERENTIAL
+S21DecodedState DaikinS21::decoded_state() const {
+  S21DecodedState state;
+  state.power_on = this->power_on;
+  state.mode = (uint8_t) this->mode;
+  state.setpoint = this->setpoint;
+  state.fan = (uint8_t) this->fan;
+  state.swing_v = this->swing_v;
+  state.swing_h = this->swing_h;
+  state.temp_inside = this->temp_inside;
+  state.temp_outside = this->temp_outside;
+  state.temp_coil = this->temp_coil;
+  state.fan_rpm = this->fan_rpm;
+  state.idle = this->idle;
+  state.protocol_major = this->protocol.major;
+  return state;
+}
+
+// The assembler's verdict on the bytes of this transaction against the
+// reference reader's, before any checksum quirk is applied.
+void DaikinS21::check_frame(FrameResult result) {
   std::vector<uint8_t> payload;
-  for (size_t i = 0; i < frame.size(); i++) {
-    if (i < code.size()) {
-      rcode.push_back(frame[i]);
-    } else {
-      payload.push_back(frame[i]);
-    }
+  S21ReferenceFrame ref = s21_reference_unframe(this->diff_rx, payload);
+  this->diff_stats.frames++;
+  bool same = result == FrameResult::Frame
+                  ? ref == S21ReferenceFrame::Frame &&
+                        payload.size() == this->assembler.size() &&
+                        std::equal(payload.begin(), payload.end(),
+                                   this->assembler.data())
+                  : ref == S21ReferenceFrame::ChecksumError;
+  if (!same) {
+    this->diff_stats.mismatches++;
+    ESP_LOGE(TAG, "Frame reader mismatch on %s: engine %s, reference %s",
+             hex_repr(this->diff_rx).c_str(),
+             result == FrameResult::Frame ? "frame" : "checksum error",
+             ref == S21ReferenceFrame::Frame           ? "frame"
+             : ref == S21ReferenceFrame::ChecksumError ? "checksum error"
+                                                       : "no frame");
+  }
+}
+
+// Runs parse_response and the reference decoder from the same starting
+// state and compares the outcome. Returns parse_response's result.
+bool DaikinS21::check_decode(const std::vector<uint8_t> &rcode,
+                             const std::vector<uint8_t> &payload) {
+  S21DecodedState ref = this->decoded_state();
+  bool parsed = this->parse_response(rcode, payload);
+  std::vector<uint8_t> frame(rcode);
+  frame.insert(frame.end(), payload.begin(), payload.end());
+  bool ref_parsed = s21_reference_decode(frame, rcode.size(), ref);
+
+  this->diff_stats.decodes++;
+  S21DecodedState state = this->decoded_state();
+  if (parsed != ref_parsed || state != ref) {
+    this->diff_stats.mismatches++;
+    ESP_LOGE(TAG, "Decoder mismatch on %s", str_repr(frame).c_str());
+    ESP_LOGE(TAG, "  engine:    %s%s", state.to_string().c_str(),
+             parsed ? "" : " (rejected)");
+    ESP_LOGE(TAG, "  reference: %s%s", ref.to_string().c_str(),
+             ref_parsed ? "" : " (rejected)");
   }
+  return parsed;
+}
+
+void DaikinS21::check_command(S21Command cmd, const uint8_t *payload,
+                              const uint8_t *reference) {
+  this->diff_stats.commands++;
+  if (memcmp(payload, reference, S21_COMMAND_PAYLOAD_SIZE) != 0) {
+    this->diff_stats.mismatches++;
+    ESP_LOGE(TAG, "%s encoder mismatch: engine %s, reference %s",
+             s21_command_to_code(cmd),
+             str_repr(payload, S21_COMMAND_PAYLOAD_SIZE).c_str(),
+             str_repr(reference, S21_COMMAND_PAYLOAD_SIZE).c_str());
+  }
+}
 
-  return parse_response(rcode, payload);
+void DaikinS21::log_differential() {
+  const S21DifferentialStats &d = this->diff_stats;
+  ESP_LOGI(TAG,
+           "Differential check: %" PRIu32 " frames, %" PRIu32
+           " decodes, %" PRIu32 " commands, %" PRIu32 " mismatches",
+           d.frames, d.decodes, d.commands, d.mismatches);
+  this->diff_stats = S21DifferentialStats();
+}
+#endif
+
+void DaikinS21::trace_junk(uint8_t byte) {
+  if (this->junk_bytes++ < S21_TRACE_JUNK_BYTES) {
+    this->trace(S21TraceEvent::UnexpectedByte, &byte, 1);
+  }
 }
 
 bool DaikinS21::parse_response(std::vector<uint8_t> rcode,
                                std::vector<uint8_t> payload) {
   if (this->debug_protocol) {
-    ESP_LOGD(TAG, "S21: %s -> %s (%d)", str_repr(rcode).c_str(),
-             str_repr(payload).c_str(), payload.size());
+    ESP_LOGD(TAG, "S21: %s -> %s (%u)", str_repr(rcode).c_str(),
+             str_repr(payload).c_str(), (unsigned) payload.size());
+  }
+
+  if (rcode.size() == 1 && rcode[0] == 'M') {  // M -> Model code
+    memset(this->protocol.model, 0, sizeof(this->protocol.model));
+    std::copy_n(payload.begin(),
+                std::min(payload.size(), sizeof(this->protocol.model) - 1),
+                this->protocol.model);
+    return true;
+  }
+
+  // The decoders below index into the payload directly.
+  size_t need = rcode.size() < 2 ? 0 : s21_payload_size(rcode[0], rcode[1]);
+  if (rcode.size() < 2 || payload.size() < need) {
+    if (this->note_warning(S21Warning::ShortResponse)) {
+      ESP_LOGW(TAG, "Short response %s -> \"%s\" (need %u payload bytes)",
+               str_repr(rcode).c_str(), str_repr(payload).c_str(),
+               (unsigned) need);
+    }
+    return false;
   }
 
   switch (rcode[0]) {
     case 'G':      // F -> G
       switch (rcode[1]) {
+        case '8':  // F8 -> G8 -- Protocol version, e.g. "0200" for 2
+          this->protocol.major = isdigit(payload[1]) ? payload[1] - '0' : 0;
+          return true;
+        case 'Y':  // FY00 -> GY00 -- Detailed version, protocol 3 and up
+          memset(this->protocol.version, 0, sizeof(this->protocol.version));
+          std::copy_n(
+              payload.begin(),
+              std::min(payload.size(), sizeof(this->protocol.version) - 1),
+              this->protocol.version);
+          return true;
         case '1':  // F1 -> Basic State
+          if (this->ready && (this->power_on != (payload[0] == '1') ||
+                              this->mode != (DaikinClimateMode) payload[1])) {
+            this->last_transition = millis();
+          }
           this->power_on = (payload[0] == '1');
           this->mode = (DaikinClimateMode) payload[1];
-          this->setpoint = ((payload[2] - 28) * 5);  // Celsius * 10
+          this->setpoint = setpoint_byte_to_c10(payload[2]);
           this->fan = (DaikinFanMode) payload[3];
           return true;
         case '5':  // F5 -> G5 -- Swing state
@@ -320,23 +872,29 @@ bool DaikinS21::parse_response(std::vector<uint8_t> rcode,
           return true;
         case '9':  // F9 -> G9 -- Inside temperature
           this->temp_inside = temp_f9_byte_to_c10(&payload[0]);
-          this->temp_outside = temp_f9_byte_to_c10(&payload[1]);
+          // A fresh group reading is from Ra, with a finer resolution.
+          if (!this->group_outdoor_fresh()) {
+            this->temp_outside = temp_f9_byte_to_c10(&payload[1]);
+          }
           return true;
       }
       break;
     case 'S':      // R -> S
       switch (rcode[1]) {
         case 'H':  // Inside temperature
-          this->temp_inside = temp_bytes_to_c10(payload);
+          this->temp_inside = temp_bytes_to_c10(&payload[0]);
           return true;
         case 'I':  // Coil temperature
-          this->temp_coil = temp_bytes_to_c10(payload);
+          this->temp_coil = temp_bytes_to_c10(&payload[0]);
           return true;
         case 'a':  // Outside temperature
-          this->temp_outside = temp_bytes_to_c10(payload);
+          this->temp_outside = temp_bytes_to_c10(&payload[0]);
+          if (this->outdoor_group != nullptr) {
+            this->outdoor_group->publish(this->temp_outside);
+          }
           return true;
         case 'L':  // Fan speed
-          this->fan_rpm = bytes_to_num(payload) * 10;
+          this->fan_rpm = bytes_to_num(&payload[0], payload.size()) * 10;
           return true;
         case 'd':  // Compressor state / frequency? Idle if 0.
           this->idle =
@@ -344,7 +902,7 @@ bool DaikinS21::parse_response(std::vector<uint8_t> rcode,
           return true;
         default:
           if (payload.size() > 3) {
-            int8_t temp = temp_bytes_to_c10(payload);
+            int8_t temp = temp_bytes_to_c10(&payload[0]);
             ESP_LOGD(TAG, "Unknown temp: %s -> %s -> %.1f C (%.1f F)",
                      str_repr(rcode).c_str(), str_repr(payload).c_str(),
                      c10_c(temp), c10_f(temp));
@@ -357,43 +915,540 @@ bool DaikinS21::parse_response(std::vector<uint8_t> rcode,
   return false;
 }
 
-bool DaikinS21::run_queries(std::vector<std::string> queries) {
-  bool success = true;
+void DaikinS21::run_queries(std::vector<std::string> queries) {
+  for (auto &q : queries) {
+    bool queued = this->query(q, [this](S21Result result) {
+      this->cycle_ok = this->cycle_ok && result == S21Result::Ok;
+    });
+    this->cycle_ok = this->cycle_ok && queued;
+  }
+}
+
+void DaikinS21::suspend() {
+  if (this->suspended)
+    return;
+  ESP_LOGI(TAG, "Suspending S21 bus traffic");
+  this->suspended = true;
+}
 
-  for (auto q : queries) {
-    std::vector<uint8_t> code(q.begin(), q.end());
-    success = this->s21_query(code) && success;
+void DaikinS21::resume() {
+  if (!this->suspended)
+    return;
+  ESP_LOGI(TAG, "Resuming S21 bus traffic");
+  this->suspended = false;
+  // Anything may have been changed by IR remote meanwhile; resync basic
+  // state right away rather than waiting for the next poll.
+  this->query("F1", nullptr);
+}
+
+static uint16_t poll_query_bit(const char *code);
+
+// Picks the poll profile from the current state. Run before each group of
+// queries, so non-core polling already follows a change the core queries
+// just decoded.
+void DaikinS21::select_profile() {
+  S21PollProfile profile = S21PollProfile::Running;
+  if (this->link_faulted) {
+    profile = S21PollProfile::Degraded;
+  } else if (this->is_command_pending() ||
+             (this->last_transition != 0 &&
+              millis() - this->last_transition < S21_TRANSITION_MS)) {
+    profile = S21PollProfile::Transitioning;
+  } else if (!this->power_on) {
+    profile = S21PollProfile::Off;
   }
+  if (profile != this->profile) {
+    ESP_LOGD(TAG, "Poll profile %s -> %s",
+             s21_poll_profile_to_string(this->profile),
+             s21_poll_profile_to_string(profile));
+    this->profile = profile;
+  }
+}
 
-  return success;  // True if all queries successful
+void DaikinS21::set_outdoor_group(S21OutdoorGroup *group) {
+  this->outdoor_group = group;
+  group->add_member(this);
+}
+
+bool DaikinS21::polls_outdoor() {
+  return this->negotiated && !this->suspended &&
+         (this->plan & poll_query_bit("Ra"));
+}
+
+// The group holds a reading taken within the last update interval; an older
+// one may be from a member that has since dropped off.
+bool DaikinS21::group_outdoor_fresh() {
+  return this->outdoor_group != nullptr && this->outdoor_group->has_value() &&
+         millis() - this->outdoor_group->get_updated() <=
+             this->get_update_interval();
+}
+
+bool S21OutdoorGroup::should_poll(DaikinS21 *member) {
+  if (this->updated == 0 || millis() - this->updated > S21_GROUP_STALE_MS) {
+    return true;
+  }
+  return this->members[this->owner] == member;
+}
+
+void S21OutdoorGroup::publish(int16_t temp_outside) {
+  this->temp_outside = temp_outside;
+  this->updated = millis();
+  // Hand over to the next member that can actually poll.
+  for (size_t n = 1; n <= this->members.size(); n++) {
+    size_t next = (this->owner + n) % this->members.size();
+    if (this->members[next]->polls_outdoor()) {
+      this->owner = next;
+      break;
+    }
+  }
+}
+
+void DaikinS21::set_profile_interval(S21PollProfile profile, const char *code,
+                                     uint8_t interval) {
+  for (size_t i = 0; i < S21_POLL_QUERY_COUNT; i++) {
+    if (strcmp(S21_POLL_QUERIES[i].code, code) == 0) {
+      this->profiles.interval[(size_t) profile][i] = interval;
+    }
+  }
+}
+
+// Polls the planned queries of one kind that are due this cycle under the
+// current profile, in priority order. A query the unit keeps rejecting is
+// dropped from the plan for good.
+void DaikinS21::poll(bool core) {
+  this->select_profile();
+  // The group's reading is the latest one, whoever took it.
+  if (this->group_outdoor_fresh()) {
+    this->temp_outside = this->outdoor_group->get_temp_outside();
+  }
+  for (uint8_t i : this->poll_order) {
+    const S21QuerySchedule &sched = this->query_plan.queries[i];
+    uint8_t interval = this->profiles.interval[(size_t) this->profile][i];
+    if (interval == S21_PROFILE_KEEP) {
+      interval = sched.interval;
+    }
+    if (S21_POLL_QUERIES[i].core != core || !(this->plan & (1 << i)) ||
+        !sched.enabled || interval == 0 ||
+        this->cycle_count % interval != 0) {
+      continue;
+    }
+    if ((1 << i) == poll_query_bit("Ra") && this->outdoor_group != nullptr &&
+        !this->outdoor_group->should_poll(this)) {
+      continue;
+    }
+    bool queued =
+        this->query(S21_POLL_QUERIES[i].code, [this, i](S21Result result) {
+          this->cycle_ok = this->cycle_ok && result == S21Result::Ok;
+          if (result != S21Result::Nak) {
+            this->poll_naks[i] = 0;
+            return;
+          }
+          if (++this->poll_naks[i] >= S21_UNSUPPORTED_NAKS) {
+            ESP_LOGW(TAG, "%s keeps being rejected, no longer polling it",
+                     S21_POLL_QUERIES[i].code);
+            this->poll_naks[i] = 0;
+            this->protocol.supported &= ~(1 << i);
+            this->select_plan();
+            this->save_protocol_info();
+          }
+        });
+    this->cycle_ok = this->cycle_ok && queued;
+  }
+}
+
+static uint16_t poll_query_bit(const char *code) {
+  for (size_t i = 0; i < S21_POLL_QUERY_COUNT; i++) {
+    if (strcmp(S21_POLL_QUERIES[i].code, code) == 0) {
+      return 1 << i;
+    }
+  }
+  return 0;
+}
+
+void DaikinS21::select_plan() {
+  // F1 is always polled; without it nothing works anyway.
+  this->plan = this->protocol.supported | poll_query_bit("F1");
+  // RH and Ra report the same temperatures as F9 at higher resolution, so
+  // F9 is only worth a transaction when one of them is missing.
+  uint16_t precise = poll_query_bit("RH") | poll_query_bit("Ra");
+  if ((this->plan & precise) == precise) {
+    this->plan &= ~poll_query_bit("F9");
+  }
+}
+
+// Defaults (every query each cycle, table order) overlaid with the saved
+// schedule, matched by code.
+void DaikinS21::load_query_plan() {
+  for (size_t i = 0; i < S21_POLL_QUERY_COUNT; i++) {
+    S21QuerySchedule &sched = this->query_plan.queries[i];
+    strncpy(sched.code, S21_POLL_QUERIES[i].code, sizeof(sched.code));
+    sched.interval = 1;
+    sched.priority = i;
+    sched.enabled = true;
+  }
+  this->query_plan_pref = global_preferences->make_preference<S21QueryPlan>(
+      fnv1_hash(std::string("daikin_s21_query_plan/") + this->component_id) +
+      S21_QUERY_PLAN_VERSION);
+  S21QueryPlan saved;
+  if (this->query_plan_pref.load(&saved)) {
+    for (auto &entry : saved.queries) {
+      for (auto &sched : this->query_plan.queries) {
+        if (strncmp(sched.code, entry.code, sizeof(sched.code)) == 0 &&
+            entry.interval > 0) {
+          sched = entry;
+        }
+      }
+    }
+    ESP_LOGD(TAG, "Using saved query plan");
+  }
+  this->next_query_plan = this->query_plan;
+  this->apply_query_plan();
+}
+
+bool DaikinS21::set_query_schedule(const std::string &code,
+                                   optional<uint8_t> interval,
+                                   optional<uint8_t> priority,
+                                   optional<bool> enabled) {
+  for (auto &sched : this->next_query_plan.queries) {
+    if (code != sched.code) {
+      continue;
+    }
+    if (enabled.has_value() && !enabled.value() && code == "F1") {
+      ESP_LOGW(TAG, "F1 is needed for climate state, not disabling it");
+      enabled.reset();
+    }
+    if (interval.has_value()) {
+      sched.interval = std::max<uint8_t>(interval.value(), 1);
+    }
+    if (priority.has_value()) {
+      sched.priority = priority.value();
+    }
+    if (enabled.has_value()) {
+      sched.enabled = enabled.value();
+    }
+    ESP_LOGI(TAG, "%s: every %u cycles, priority %u, %s (from next cycle)",
+             sched.code, sched.interval, sched.priority,
+             sched.enabled ? "enabled" : "disabled");
+    this->query_plan_changed = true;
+    return true;
+  }
+  ESP_LOGW(TAG, "Unknown poll query %s", code.c_str());
+  return false;
+}
+
+// Switches to the pending schedule in one go; only called between cycles.
+void DaikinS21::apply_query_plan() {
+  this->query_plan = this->next_query_plan;
+  for (size_t i = 0; i < S21_POLL_QUERY_COUNT; i++) {
+    this->poll_order[i] = i;
+  }
+  std::stable_sort(this->poll_order, this->poll_order + S21_POLL_QUERY_COUNT,
+                   [this](uint8_t a, uint8_t b) {
+                     return this->query_plan.queries[a].priority <
+                            this->query_plan.queries[b].priority;
+                   });
+  if (this->query_plan_changed) {
+    this->query_plan_changed = false;
+    if (!this->query_plan_pref.save(&this->query_plan)) {
+      ESP_LOGW(TAG, "Could not save query plan");
+    }
+  }
+}
+
+void DaikinS21::save_protocol_info() {
+  if (!this->protocol_pref.save(&this->protocol)) {
+    ESP_LOGW(TAG, "Could not save protocol info");
+  }
+}
+
+void DaikinS21::log_protocol_info() {
+  std::string queries;
+  // Core queries go first each cycle, so list them first.
+  for (bool core : {true, false}) {
+    for (uint8_t i : this->poll_order) {
+      const S21QuerySchedule &sched = this->query_plan.queries[i];
+      if (S21_POLL_QUERIES[i].core == core && (this->plan & (1 << i)) &&
+          sched.enabled) {
+        if (!queries.empty())
+          queries += ' ';
+        queries += S21_POLL_QUERIES[i].code;
+        if (sched.interval > 1)
+          queries += '/' + std::to_string(sched.interval);
+      }
+    }
+  }
+  ESP_LOGCONFIG(TAG, "  Model: %s%s", this->protocol.model,
+                this->quirks->model != nullptr ? " (known)" : "");
+  ESP_LOGCONFIG(TAG, "  Protocol: %u%s%s", this->protocol.major,
+                this->protocol.version[0] ? " version " : "",
+                this->protocol.version);
+  ESP_LOGCONFIG(TAG, "  Polling: %s", queries.c_str());
+}
+
+void DaikinS21::renegotiate() {
+  ESP_LOGI(TAG, "Protocol negotiation requested");
+  this->negotiated = false;
+}
+
+// Asks the unit for its model and protocol version. Known models take their
+// supported queries from the quirk table; for others each poll query is
+// probed once. Runs through the queue like a poll cycle; if anything times
+// out the unit isn't talking yet and it is retried on the next update.
+void DaikinS21::negotiate() {
+  ESP_LOGI(TAG, "Negotiating S21 protocol");
+  this->cycle_active = true;
+  this->cycle_ok = true;
+  this->protocol = {};
+  // Only a link failure fails negotiation; a reply that doesn't decode
+  // still answers the question.
+  auto check = [this](S21Result result) {
+    if (result == S21Result::Timeout || result == S21Result::Error)
+      this->cycle_ok = false;
+  };
+  this->query("M", check);
+  this->query("F8", check);
+  bool queued = this->sync([this, check]() {
+    this->quirks = s21_find_model_quirks(this->protocol.model);
+    if (this->protocol.major >= 3) {
+      this->query("FY00", check);
+    }
+    if (this->quirks->model != nullptr) {
+      // Known model: only check that it answers.
+      this->protocol.supported =
+          ((1 << S21_POLL_QUERY_COUNT) - 1) & ~this->quirks->unsupported;
+      this->query("F1", check);
+    } else {
+      for (size_t i = 0; i < S21_POLL_QUERY_COUNT; i++) {
+        this->query(S21_POLL_QUERIES[i].code, [this, i](S21Result result) {
+          if (result == S21Result::Ok) {
+            this->protocol.supported |= 1 << i;
+          } else if (result == S21Result::Timeout ||
+                     result == S21Result::Error) {
+            this->cycle_ok = false;
+          }
+        });
+      }
+    }
+    if (!this->sync([this]() { this->finish_negotiation(this->cycle_ok); })) {
+      this->finish_negotiation(false);
+    }
+  });
+  if (!queued) {
+    this->cycle_active = false;
+  }
+}
+
+void DaikinS21::finish_negotiation(bool ok) {
+  this->cycle_active = false;
+  if (!ok || !(this->protocol.supported & poll_query_bit("F1"))) {
+    ESP_LOGW(TAG, "Protocol negotiation incomplete, will retry");
+    return;
+  }
+  this->negotiated = true;
+  this->select_plan();
+  this->save_protocol_info();
+  ESP_LOGI(TAG, "Protocol negotiated:");
+  this->log_protocol_info();
 }
 
 void DaikinS21::update() {
-  std::vector<std::string> queries = {"F1", "F5", "Rd"};
-  // These queries might fail but they won't affect the basic functionality
-  std::vector<std::string> failable_queries = {"F9", "RH", "RI", "Ra", "RL"};
-  if (this->run_queries(queries)) {
-    this->run_queries(failable_queries);
-    if(!this->ready) {
-      ESP_LOGI(TAG, "Daikin S21 Ready");
-      this->ready = true;
+  // Don't pile up cycles if the previous one is still running.
+  if (this->suspended || this->cycle_active || this->benchmarking) {
+    return;
+  }
+  if (!this->negotiated) {
+    this->negotiate();
+    return;
+  }
+  if (this->query_plan_changed) {
+    this->apply_query_plan();
+    ESP_LOGI(TAG, "Query plan updated");
+    this->log_protocol_info();
+  }
+  this->cycle_active = true;
+  this->cycle_ok = true;
+  this->cycle_link_ok = true;
+  this->poll(true);
+  bool queued = this->sync([this]() {
+    if (this->cycle_ok) {
+      // These queries might fail but they won't affect the basic functionality
+      this->poll(false);
+      if (!this->ready) {
+        ESP_LOGI(TAG, "Daikin S21 Ready");
+        this->ready = true;
+      }
+    }
+
+#ifdef S21_EXPERIMENTS
+    ESP_LOGD(TAG, "** UNKNOWN QUERIES **");
+    // auto experiments = {"F2", "F3", "F4", "F8", "F9", "F0", "FA", "FB",
+    //                     "FC", "FD", "FE", "FF", "FG", "FH", "FI", "FJ",
+    //                     "FK", "FL", "FM", "FN", "FO", "FP", "FQ", "FR",
+    //                     "FS", "FT", "FU", "FV", "FW", "FX", "FY", "FZ"};
+    // Observed BRP device querying these.
+    this->run_queries({"F2", "F3", "F4", "RN", "RX", "RD", "M", "FU0F"});
+#endif
+
+    if (!this->sync([this]() { this->finish_cycle(); })) {
+      this->finish_cycle();
+    }
+  });
+  if (!queued) {
+    this->cycle_active = false;
+  }
+}
+
+bool DaikinS21::run_benchmark(uint8_t rounds) {
+  if (this->benchmarking || !this->negotiated || rounds == 0) {
+    ESP_LOGW(TAG, "Benchmark not started (%s)",
+             this->benchmarking ? "already running" : "not ready");
+    return false;
+  }
+  ESP_LOGI(TAG, "Benchmarking %u rounds per query", rounds);
+  this->benchmarking = true;
+  this->bench_rounds = rounds;
+  this->bench_query = 0;
+  this->bench_results.clear();
+  this->bench_samples.reserve(rounds);
+  // Let a poll cycle in progress finish first.
+  if (!this->sync([this]() { this->benchmark_next(); })) {
+    this->benchmark_done();
+  }
+  return true;
+}
+
+void DaikinS21::benchmark_next() {
+  while (this->bench_query < S21_POLL_QUERY_COUNT &&
+         !(this->plan & (1 << this->bench_query))) {
+    this->bench_query++;
+  }
+  if (this->bench_query == S21_POLL_QUERY_COUNT) {
+    this->benchmark_done();
+    return;
+  }
+  this->bench_samples.clear();
+  this->bench_failures = 0;
+  this->benchmark_step(this->bench_rounds);
+}
+
+// One query of the current code; latency runs from the start of the
+// request's TX to completion, so time spent queued doesn't count.
+void DaikinS21::benchmark_step(uint8_t remaining) {
+  const char *code = S21_POLL_QUERIES[this->bench_query].code;
+  bool queued = this->query(code, [this, code, remaining](S21Result result) {
+    if (result == S21Result::Ok) {
+      this->bench_samples.push_back(this->txn_end - this->txn_start);
+    } else {
+      this->bench_failures++;
+    }
+    if (remaining > 1) {
+      this->benchmark_step(remaining - 1);
+      return;
+    }
+    S21BenchmarkResult r{code, 0, 0, 0, this->bench_rounds,
+                         this->bench_failures};
+    auto &samples = this->bench_samples;
+    if (!samples.empty()) {
+      std::sort(samples.begin(), samples.end());
+      r.min_ms = samples.front();
+      r.median_ms = samples[samples.size() / 2];
+      r.max_ms = samples.back();
     }
+    this->bench_results.push_back(r);
+    this->bench_query++;
+    this->benchmark_next();
+  });
+  if (!queued) {
+    this->benchmark_done();
   }
+}
+
+void DaikinS21::benchmark_done() {
+  this->benchmarking = false;
+  this->bench_samples = {};
+  std::string json = "{";
+  char buf[48];
+  ESP_LOGI(TAG, "Benchmark results (min/median/max ms, failure %%):");
+  for (auto &r : this->bench_results) {
+    unsigned failure_pct = r.failures * 100 / r.runs;
+    ESP_LOGI(TAG, "  %s: %u/%u/%u, %u%%", r.code, r.min_ms, r.median_ms,
+             r.max_ms, failure_pct);
+    snprintf(buf, sizeof(buf), "%s\"%s\":[%u,%u,%u,%u]",
+             json.size() > 1 ? "," : "", r.code, r.min_ms, r.median_ms,
+             r.max_ms, failure_pct);
+    json += buf;
+  }
+  json += "}";
+  this->benchmark_callback_.call(json);
+}
+
+void DaikinS21::finish_cycle() {
+  this->cycle_count++;
   if (this->debug_protocol) {
     this->dump_state();
   }
+  if (this->cycle_link_ok && this->link_faulted) {
+    // The whole cycle went through without a link failure.
+    uint32_t elapsed = millis() - this->fault_start;
+    this->stats.recoveries++;
+    this->stats.last_recovery_ms = elapsed;
+    s21_histogram_add(S21_RECOVERY_BUCKETS_MS, S21_RECOVERY_BUCKET_COUNT,
+                      this->stats.recovery_buckets,
+                      &this->stats.recovery_sum_ms, elapsed);
+    ESP_LOGI(TAG, "Recovered from link fault after %" PRIu32 "ms", elapsed);
+    this->link_faulted = false;
+  }
+  this->trace_point(S21TracePoint::Publish);
+#ifdef USE_DAIKIN_S21_BEACON
+  this->send_beacon();
+#endif
+  this->cycle_active = false;
+  this->cycle_callback_.call();
+}
 
-#ifdef S21_EXPERIMENTS
-  ESP_LOGD(TAG, "** UNKNOWN QUERIES **");
-  // auto experiments = {"F2", "F3", "F4", "F8", "F9", "F0", "FA", "FB", "FC",
-  //                     "FD", "FE", "FF", "FG", "FH", "FI", "FJ", "FK", "FL",
-  //                     "FM", "FN", "FO", "FP", "FQ", "FR", "FS", "FT", "FU",
-  //                     "FV", "FW", "FX", "FY", "FZ"};
-  // Observed BRP device querying these.
-  std::vector<std::string> experiments = {"F2", "F3", "F4", "RN",
-                                          "RX", "RD", "M",  "FU0F"};
-  this->run_queries(experiments);
+// Emits one line with the counts of warnings that were not logged in full
+// during the last interval. With debug_protocol, the trace is dumped too.
+void DaikinS21::log_warning_summary() {
+  uint32_t now = millis();
+  if (now - this->warnings_since < S21_WARNING_SUMMARY_INTERVAL) {
+    return;
+  }
+  if (this->warnings.any_suppressed()) {
+    std::string summary;
+    char buf[40];
+    for (size_t i = 0; i < (size_t) S21Warning::COUNT; i++) {
+      uint32_t n = this->warnings.suppressed((S21Warning) i);
+      if (n > 0) {
+        snprintf(buf, sizeof(buf), "%s%s x%" PRIu32,
+                 summary.empty() ? "" : ", ",
+                 s21_warning_to_string((S21Warning) i), n);
+        summary += buf;
+      }
+    }
+    ESP_LOGW(TAG, "Suppressed in last %" PRIu32 "s: %s",
+             (now - this->warnings_since) / 1000, summary.c_str());
+    if (this->debug_protocol) {
+      this->dump_trace();
+    }
+  }
+#ifdef S21_DIFFERENTIAL
+  this->log_differential();
 #endif
+  this->warnings.reset();
+  this->warnings_since = now;
+}
+
+void DaikinS21::dump_trace() {
+  ESP_LOGD(TAG, "** BEGIN TRACE *****************************");
+  for (size_t i = 0; i < this->trace_buffer.size(); i++) {
+    const S21TraceEntry &e = this->trace_buffer.at(i);
+    size_t len = e.len < S21_TRACE_DATA_SIZE ? e.len : S21_TRACE_DATA_SIZE;
+    ESP_LOGD(TAG, "%10" PRIu32 " %-7s %s%s", e.ms,
+             s21_trace_event_to_string(e.event),
+             hex_repr(e.data, len).c_str(),
+             e.len > len ? ":.." : "");
+  }
+  ESP_LOGD(TAG, "** END TRACE *****************************");
 }
 
 void DaikinS21::dump_state() {
@@ -420,68 +1475,329 @@ void DaikinS21::dump_state() {
   ESP_LOGD(TAG, "** END STATE *****************************");
 }
 
-void DaikinS21::set_daikin_climate_settings(bool power_on,
-                                            DaikinClimateMode mode,
-                                            float setpoint,
-                                            DaikinFanMode fan_mode) {
-  // clang-format off
-  std::vector<uint8_t> cmd = {
-    (uint8_t)(power_on ? '1' : '0'),
-    (uint8_t) mode,
-    c10_to_setpoint_byte(lroundf(round(setpoint * 2) / 2 * 10.0)),
-    (uint8_t) fan_mode
-  };
-  // clang-format on
-  ESP_LOGD(TAG, "Sending basic climate CMD (D1): %s", str_repr(cmd).c_str());
-  if (!this->send_cmd({'D', '1'}, cmd)) {
-    ESP_LOGW(TAG, "Failed basic climate CMD");
-  } else {
-    this->update();
+// Polls queries until check() passes, so a command's effect is picked up
+// without waiting for the next full update cycle. check() runs once the last
+// query of a round has completed; rounds stop once millis() reaches until.
+void DaikinS21::confirm(std::vector<const char *> queries,
+                        std::function<bool()> &&check, uint32_t until,
+                        std::function<void(bool)> &&done) {
+  auto ok = std::make_shared<bool>(true);
+  bool queued = true;
+  for (size_t i = 0; queued && i < queries.size(); i++) {
+    bool last = i + 1 == queries.size();
+    queued = this->query(queries[i], [this, queries, check, until, done, ok,
+                                      last](S21Result result) mutable {
+      *ok = *ok && result == S21Result::Ok;
+      if (!last) {
+        return;
+      }
+      if (*ok && check()) {
+        done(true);
+      } else if ((int32_t) (millis() + S21_CONFIRM_INTERVAL - until) > 0) {
+        done(false);
+      } else {
+        this->set_timeout(S21_CONFIRM_INTERVAL, [this, queries, check, until,
+                                                 done]() mutable {
+          this->confirm(std::move(queries), std::move(check), until,
+                        std::move(done));
+        });
+      }
+    });
+  }
+  if (!queued) {
+    done(false);
   }
 }
 
-void DaikinS21::set_swing_settings(bool swing_v, bool swing_h) {
-  std::vector<uint8_t> cmd = {
-      (uint8_t) ('0' + (swing_h ? 2 : 0) + (swing_v ? 1 : 0) +
-                 (swing_h && swing_v ? 4 : 0)),
-      (uint8_t) (swing_v || swing_h ? '?' : '0'), '0', '0'};
-  ESP_LOGD(TAG, "Sending swing CMD (D5): %s", str_repr(cmd).c_str());
-  if (!this->send_cmd({'D', '5'}, cmd)) {
-    ESP_LOGW(TAG, "Failed swing CMD");
-  } else {
-    this->update();
+bool DaikinS21::is_command_pending() {
+  for (auto &entry : this->journal) {
+    if (entry.active)
+      return true;
   }
+  return false;
 }
 
-bool DaikinS21::send_cmd(std::vector<uint8_t> code,
-                         std::vector<uint8_t> payload) {
-  std::vector<uint8_t> frame;
-  uint8_t byte;
-
-  for (auto b : code) {
-    frame.push_back(b);
+bool DaikinS21::state_matches(S21Command cmd, const uint8_t *payload) {
+  if (cmd == S21Command::Swing) {
+    uint8_t swing = payload[0] - '0';
+    return this->swing_v == bool(swing & 1) && this->swing_h == bool(swing & 2);
   }
-  for (auto b : payload) {
-    frame.push_back(b);
+  // A unit that is off may report a different mode, setpoint or fan than
+  // the ones sent with the power off, so only the power byte counts.
+  if (payload[0] == '0') {
+    return !this->power_on;
   }
-
-  this->write_frame(frame);
-  if (!this->rx_uart->read_byte(&byte)) {
-    ESP_LOGW(TAG, "Timeout waiting for ACK to %s", str_repr(frame).c_str());
+  if (!this->power_on || (uint8_t) this->mode != payload[1]) {
     return false;
   }
-  if (byte == NAK) {
-    ESP_LOGW(TAG, "Got NAK for frame: %s", str_repr(frame).c_str());
+  // Units keep their own setpoint in fan and dry modes, and run the fan on
+  // auto in dry, so those fields are only compared where they apply. The
+  // same rule as DaikinS21Climate::should_check_setpoint.
+  auto mode = (DaikinClimateMode) payload[1];
+  bool uses_setpoint = mode == DaikinClimateMode::Auto ||
+                       mode == DaikinClimateMode::Cool ||
+                       mode == DaikinClimateMode::Heat;
+  if (uses_setpoint && c10_to_setpoint_byte(this->setpoint) != payload[2]) {
     return false;
   }
-  if (byte != ACK) {
-    ESP_LOGW(TAG, "Unexpected byte waiting for ACK: %s",
-             str_repr(&byte, 1).c_str());
+  return mode == DaikinClimateMode::Dry || (uint8_t) this->fan == payload[3];
+}
+
+// Records the latest desired state for cmd. Returns true if an attempt
+// should be started; one in flight picks up the new payload when it ends.
+bool DaikinS21::stage(S21Command cmd, const uint8_t *payload) {
+  S21JournalEntry &entry = this->journal[(size_t) cmd];
+  if (entry.active) {
+    this->stats.commands[(size_t) cmd].coalesced++;
+  }
+  memcpy(entry.payload, payload, S21_COMMAND_PAYLOAD_SIZE);
+  entry.generation++;
+  entry.attempts = 0;
+  entry.start = millis();
+  entry.active = true;
+  if (entry.in_flight) {
     return false;
   }
-
+  // A pending retry is brought forward.
+  this->cancel_timeout(s21_command_to_code(cmd));
   return true;
 }
 
+// Records the latest desired state for cmd and makes sure it gets sent.
+void DaikinS21::submit(S21Command cmd, const uint8_t *payload) {
+  if (this->stage(cmd, payload)) {
+    this->attempt(cmd);
+  }
+}
+
+// Marks cmd in flight; returns the generation being sent.
+uint8_t DaikinS21::start_attempt(S21Command cmd) {
+  S21JournalEntry &entry = this->journal[(size_t) cmd];
+  if (entry.attempts++ > 0) {
+    this->stats.commands[(size_t) cmd].retries++;
+  }
+  entry.in_flight = true;
+  ESP_LOGD(TAG, "Sending %s: %s (attempt %u)", s21_command_to_code(cmd),
+           str_repr(entry.payload, S21_COMMAND_PAYLOAD_SIZE).c_str(),
+           entry.attempts);
+  return entry.generation;
+}
+
+static std::vector<uint8_t> command_code(S21Command cmd) {
+  const char *code = s21_command_to_code(cmd);
+  return {(uint8_t) code[0], (uint8_t) code[1]};
+}
+
+void DaikinS21::attempt(S21Command cmd) {
+  S21JournalEntry &entry = this->journal[(size_t) cmd];
+  std::vector<uint8_t> payload(entry.payload,
+                               entry.payload + S21_COMMAND_PAYLOAD_SIZE);
+  uint8_t generation = this->start_attempt(cmd);
+  bool queued = this->send_cmd(
+      command_code(cmd), payload,
+      [this, cmd, generation, payload](S21Result result) {
+        if (result != S21Result::Ok) {
+          ESP_LOGD(TAG, "%s not accepted (%s)", s21_command_to_code(cmd),
+                   s21_result_to_string(result));
+          this->attempt_done(cmd, generation, false);
+          return;
+        }
+        this->confirm(
+            {cmd == S21Command::Swing ? "F5" : "F1"},
+            [this, cmd, payload]() {
+              return this->state_matches(cmd, payload.data());
+            },
+            millis() + this->confirm_timeout,
+            [this, cmd, generation](bool confirmed) {
+              this->attempt_done(cmd, generation, confirmed);
+            });
+      });
+  if (!queued) {
+    this->attempt_done(cmd, generation, false);
+  }
+}
+
+// Sends D1 and D5 back to back and confirms both with one F1/F5 round, so
+// a full state change takes a single round trip. Whichever command fails is
+// retried on its own.
+void DaikinS21::attempt_state() {
+  S21JournalEntry &climate = this->journal[(size_t) S21Command::Climate];
+  S21JournalEntry &swing = this->journal[(size_t) S21Command::Swing];
+  std::vector<uint8_t> d1(climate.payload,
+                          climate.payload + S21_COMMAND_PAYLOAD_SIZE);
+  std::vector<uint8_t> d5(swing.payload,
+                          swing.payload + S21_COMMAND_PAYLOAD_SIZE);
+  uint8_t gen1 = this->start_attempt(S21Command::Climate);
+  uint8_t gen5 = this->start_attempt(S21Command::Swing);
+  auto d1_ok = std::make_shared<bool>(false);
+  if (!this->send_cmd(command_code(S21Command::Climate), d1,
+                      [this, gen1, d1_ok](S21Result result) {
+                        *d1_ok = result == S21Result::Ok;
+                        if (!*d1_ok) {
+                          this->attempt_done(S21Command::Climate, gen1, false);
+                        }
+                      })) {
+    this->attempt_done(S21Command::Climate, gen1, false);
+  }
+  bool queued = this->send_cmd(
+      command_code(S21Command::Swing), d5,
+      [this, gen1, gen5, d1_ok](S21Result result) {
+        bool d5_ok = result == S21Result::Ok;
+        if (!d5_ok) {
+          this->attempt_done(S21Command::Swing, gen5, false);
+        }
+        if (!*d1_ok && !d5_ok) {
+          return;
+        }
+        bool d1_sent = *d1_ok;
+        this->confirm(
+            {"F1", "F5"},
+            [this, d1_sent, d5_ok]() {
+              return (!d1_sent || this->state_matches(S21Command::Climate)) &&
+                     (!d5_ok || this->state_matches(S21Command::Swing));
+            },
+            millis() + this->confirm_timeout,
+            [this, gen1, gen5, d1_sent, d5_ok](bool) {
+              if (d1_sent) {
+                this->attempt_done(S21Command::Climate, gen1,
+                                   this->state_matches(S21Command::Climate));
+              }
+              if (d5_ok) {
+                this->attempt_done(S21Command::Swing, gen5,
+                                   this->state_matches(S21Command::Swing));
+              }
+            });
+      });
+  if (!queued) {
+    this->attempt_done(S21Command::Swing, gen5, false);
+  }
+}
+
+void DaikinS21::attempt_done(S21Command cmd, uint8_t generation,
+                             bool confirmed) {
+  S21JournalEntry &entry = this->journal[(size_t) cmd];
+  entry.in_flight = false;
+  if (generation != entry.generation) {
+    // Superseded while in flight; only the latest state matters.
+    this->attempt(cmd);
+    return;
+  }
+  if (confirmed) {
+    this->command_done(cmd, true);
+    return;
+  }
+  uint32_t backoff = S21_RETRY_BACKOFF << (entry.attempts - 1);
+  if (entry.attempts >= S21_COMMAND_ATTEMPTS ||
+      millis() + backoff - entry.start > S21_COMMAND_DEADLINE) {
+    ESP_LOGW(TAG, "Giving up on %s after %u attempts",
+             s21_command_to_code(cmd), entry.attempts);
+    this->command_done(cmd, false);
+    return;
+  }
+  ESP_LOGD(TAG, "Retrying %s in %" PRIu32 "ms", s21_command_to_code(cmd),
+           backoff);
+  this->set_timeout(s21_command_to_code(cmd), backoff,
+                    [this, cmd]() { this->attempt(cmd); });
+}
+
+void DaikinS21::command_done(S21Command cmd, bool confirmed) {
+  S21JournalEntry &entry = this->journal[(size_t) cmd];
+  S21CommandStats &cs = this->stats.commands[(size_t) cmd];
+  if (confirmed) {
+    cs.last_latency_ms = millis() - entry.start;
+    s21_histogram_add(S21_COMMAND_LATENCY_BUCKETS_MS,
+                      S21_COMMAND_LATENCY_BUCKET_COUNT, cs.latency_buckets,
+                      &cs.latency_sum_ms, cs.last_latency_ms);
+    ESP_LOGD(TAG, "%s confirmed after %" PRIu32 "ms", s21_command_to_code(cmd),
+             cs.last_latency_ms);
+  } else {
+    cs.failed++;
+  }
+  entry.active = false;
+  this->last_cmd = cmd;
+  this->last_confirmed = confirmed;
+  this->trace_point(S21TracePoint::Publish);
+  this->command_callback_.call();
+}
+
+void DaikinS21::climate_payload(uint8_t *out, bool power_on,
+                                DaikinClimateMode mode, float setpoint,
+                                DaikinFanMode fan_mode) {
+  out[0] = power_on ? '1' : '0';
+  out[1] = (uint8_t) mode;
+  out[2] = c10_to_setpoint_byte(lroundf(round(setpoint * 2) / 2 * 10.0));
+  out[3] = (uint8_t) fan_mode;
+#ifdef S21_DIFFERENTIAL
+  uint8_t ref[S21_COMMAND_PAYLOAD_SIZE];
+  s21_reference_d1(power_on, (uint8_t) mode, setpoint, (uint8_t) fan_mode,
+                   ref);
+  this->check_command(S21Command::Climate, out, ref);
+#endif
+}
+
+void DaikinS21::swing_payload(uint8_t *out, bool swing_v, bool swing_h) {
+  out[0] = '0' + (swing_h ? 2 : 0) + (swing_v ? 1 : 0) +
+           (swing_h && swing_v ? 4 : 0);
+  out[1] = swing_v || swing_h ? '?' : '0';
+  out[2] = '0';
+  out[3] = '0';
+#ifdef S21_DIFFERENTIAL
+  uint8_t ref[S21_COMMAND_PAYLOAD_SIZE];
+  s21_reference_d5(swing_v, swing_h, ref);
+  this->check_command(S21Command::Swing, out, ref);
+#endif
+}
+
+void DaikinS21::set_daikin_climate_settings(bool power_on,
+                                            DaikinClimateMode mode,
+                                            float setpoint,
+                                            DaikinFanMode fan_mode) {
+  uint8_t cmd[S21_COMMAND_PAYLOAD_SIZE];
+  this->climate_payload(cmd, power_on, mode, setpoint, fan_mode);
+  ESP_LOGD(TAG, "Basic climate CMD (D1): %s",
+           str_repr(cmd, sizeof(cmd)).c_str());
+  this->submit(S21Command::Climate, cmd);
+}
+
+void DaikinS21::set_swing_settings(bool swing_v, bool swing_h) {
+  uint8_t cmd[S21_COMMAND_PAYLOAD_SIZE];
+  this->swing_payload(cmd, swing_v, swing_h);
+  ESP_LOGD(TAG, "Swing CMD (D5): %s", str_repr(cmd, sizeof(cmd)).c_str());
+  this->submit(S21Command::Swing, cmd);
+}
+
+void DaikinS21::set_state(bool power_on, DaikinClimateMode mode,
+                          float setpoint, DaikinFanMode fan_mode, bool swing_v,
+                          bool swing_h) {
+  uint8_t d1[S21_COMMAND_PAYLOAD_SIZE];
+  uint8_t d5[S21_COMMAND_PAYLOAD_SIZE];
+  this->climate_payload(d1, power_on, mode, setpoint, fan_mode);
+  this->swing_payload(d5, swing_v, swing_h);
+  ESP_LOGD(TAG, "State CMD (D1 %s, D5 %s)", str_repr(d1, sizeof(d1)).c_str(),
+           str_repr(d5, sizeof(d5)).c_str());
+  bool send_d1 = this->stage(S21Command::Climate, d1);
+  bool send_d5 = this->stage(S21Command::Swing, d5);
+  if (send_d1 && send_d5) {
+    this->attempt_state();
+  } else if (send_d1) {
+    this->attempt(S21Command::Climate);
+  } else if (send_d5) {
+    this->attempt(S21Command::Swing);
+  }
+}
+
+bool DaikinS21::send_cmd(std::vector<uint8_t> code,
+                         std::vector<uint8_t> payload, S21Callback done) {
+  if (this->suspended) {
+    ESP_LOGW(TAG, "S21 bus suspended, not sending %s",
+             str_repr(code).c_str());
+    return false;
+  }
+  std::vector<uint8_t> frame(code);
+  frame.insert(frame.end(), payload.begin(), payload.end());
+  return this->enqueue(frame.data(), frame.size(), code.size(), false,
+                       std::move(done));
+}
+
 }  // namespace daikin_s21
 }  // namespace esphome
@@ -1,7 +1,27 @@
 #pragma once
 
+#include <functional>
 #include "esphome/components/uart/uart.h"
+#include "esphome/core/automation.h"
 #include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+#include "esphome/core/preferences.h"
+#include "esphome/components/s21_protocol/s21_protocol.h"
+#include "s21_trace.h"
+#include "s21_tracer.h"
+#ifdef S21_DIFFERENTIAL
+#include "s21_reference.h"
+#endif
+#ifdef USE_DAIKIN_S21_METRICS
+#include "esphome/components/web_server_base/web_server_base.h"
+#endif
+#ifdef USE_DAIKIN_S21_BEACON
+#include "esphome/components/socket/socket.h"
+#include "s21_beacon.h"
+#endif
+#ifdef USE_DAIKIN_S21_TIME_ALIGN
+#include "esphome/components/time/real_time_clock.h"
+#endif
 
 namespace esphome {
 namespace daikin_s21 {
@@ -31,13 +51,320 @@ std::string daikin_fan_mode_to_string(DaikinFanMode mode);
 inline float c10_c(int16_t c10) { return c10 / 10.0; }
 inline float c10_f(int16_t c10) { return c10_c(c10) * 1.8 + 32.0; }
 
+// Upper bounds (ms) of the transaction latency histogram buckets. A query
+// round trip at 2400 baud is roughly 60-100ms on a healthy link.
+static const uint16_t S21_LATENCY_BUCKETS_MS[] = {50,  75,  100, 125,
+                                                  150, 200, 250, 500};
+static const size_t S21_LATENCY_BUCKET_COUNT =
+    sizeof(S21_LATENCY_BUCKETS_MS) / sizeof(S21_LATENCY_BUCKETS_MS[0]);
+
+// Upper bounds (ms) of the command latency histogram buckets: from a
+// command being issued to the unit reporting the requested state.
+static const uint16_t S21_COMMAND_LATENCY_BUCKETS_MS[] = {
+    250, 500, 750, 1000, 1500, 2000, 3000, 5000};
+static const size_t S21_COMMAND_LATENCY_BUCKET_COUNT =
+    sizeof(S21_COMMAND_LATENCY_BUCKETS_MS) /
+    sizeof(S21_COMMAND_LATENCY_BUCKETS_MS[0]);
+
+// Upper bounds (ms) of the fault recovery histogram buckets: from the first
+// failed transaction to the end of the next clean poll cycle.
+static const uint16_t S21_RECOVERY_BUCKETS_MS[] = {
+    2000, 4000, 6000, 10000, 15000, 20000, 30000, 60000};
+static const size_t S21_RECOVERY_BUCKET_COUNT =
+    sizeof(S21_RECOVERY_BUCKETS_MS) / sizeof(S21_RECOVERY_BUCKETS_MS[0]);
+
+// Adds a sample to per-bucket (non-cumulative) counts; buckets has room for
+// count + 1 entries, the last being overflow.
+inline void s21_histogram_add(const uint16_t *bounds, size_t count,
+                              uint32_t *buckets, uint32_t *sum_ms,
+                              uint32_t ms) {
+  size_t bucket = 0;
+  while (bucket < count && ms > bounds[bucket]) {
+    bucket++;
+  }
+  buckets[bucket]++;
+  *sum_ms += ms;
+}
+
+enum class S21Command : uint8_t {
+  Climate,  // D1
+  Swing,    // D5
+  COUNT,
+};
+
+const char *s21_command_to_code(S21Command cmd);
+
+struct S21CommandStats {
+  uint32_t failed = 0;
+  uint32_t retries = 0;
+  // Requests replaced by a newer one before being confirmed.
+  uint32_t coalesced = 0;
+  uint32_t latency_buckets[S21_COMMAND_LATENCY_BUCKET_COUNT + 1] = {};
+  uint32_t latency_sum_ms = 0;
+  uint32_t last_latency_ms = 0;
+};
+
+// Protocol counters, monotonic since boot.
+struct DaikinS21Stats {
+  uint32_t transactions = 0;
+  uint32_t naks = 0;
+  uint32_t timeouts = 0;
+  uint32_t checksum_errors = 0;
+  uint32_t decode_errors = 0;
+  uint32_t d1_writes = 0;
+  // Per-bucket (non-cumulative) latency counts, last slot is overflow.
+  uint32_t latency_buckets[S21_LATENCY_BUCKET_COUNT + 1] = {};
+  uint32_t latency_sum_ms = 0;
+  // Time spent with a transaction in flight; rate() gives bus utilisation.
+  uint32_t bus_busy_ms = 0;
+  // End-to-end latency of confirmed commands, per command type.
+  S21CommandStats commands[(size_t) S21Command::COUNT];
+  // Link faults recovered from, and how long each took.
+  uint32_t recoveries = 0;
+  uint32_t recovery_buckets[S21_RECOVERY_BUCKET_COUNT + 1] = {};
+  uint32_t recovery_sum_ms = 0;
+  uint32_t last_recovery_ms = 0;
+  // Learned quiet time enforced between transactions.
+  uint16_t frame_gap_ms = 0;
+};
+
+enum class S21Result : uint8_t {
+  Ok,
+  Nak,
+  Timeout,
+  Error,
+  // Well-framed response that couldn't be decoded; the link itself is fine.
+  DecodeError,
+};
+
+const char *s21_result_to_string(S21Result result);
+
+using S21Callback = std::function<void(S21Result result)>;
+
+// Longest request we ever send (code plus payload).
+static const size_t S21_MAX_REQUEST_SIZE = 12;
+static const size_t S21_QUEUE_SIZE = 24;
+
+// A queued request. A zero length marks a sync point, which completes as
+// soon as everything queued before it has.
+struct S21Transaction {
+  uint8_t frame[S21_MAX_REQUEST_SIZE];
+  uint8_t len;
+  uint8_t code_len;
+  bool is_query;
+  S21Callback done;
+};
+
+// Queries a poll cycle may use. Core queries must succeed for the state to
+// be considered valid; the rest only add detail.
+struct S21PollQuery {
+  const char *code;
+  bool core;
+};
+
+static const S21PollQuery S21_POLL_QUERIES[] = {
+    {"F1", true},   // Basic state
+    {"F5", true},   // Swing
+    {"Rd", true},   // Compressor
+    {"F9", false},  // Inside and outside temperature, 0.5 C resolution
+    {"RH", false},  // Inside temperature
+    {"RI", false},  // Coil temperature
+    {"Ra", false},  // Outside temperature
+    {"RL", false},  // Fan speed
+};
+static const size_t S21_POLL_QUERY_COUNT =
+    sizeof(S21_POLL_QUERIES) / sizeof(S21_POLL_QUERIES[0]);
+
+// Runtime tuning of one poll query. The code is stored alongside so a saved
+// plan still lines up if S21_POLL_QUERIES changes.
+struct S21QuerySchedule {
+  char code[3];
+  uint8_t interval;  // Poll every Nth cycle; 1 is every cycle
+  uint8_t priority;  // Lower goes first within core / non-core queries
+  bool enabled;
+};
+
+// Whole query plan, saved as one preference record.
+struct S21QueryPlan {
+  S21QuerySchedule queries[S21_POLL_QUERY_COUNT];
+};
+
+// Polling profiles, picked from the decoded state. Highest priority last.
+enum class S21PollProfile : uint8_t {
+  Running,        // Powered on, steady
+  Off,            // Powered off
+  Transitioning,  // Command pending, or power/mode changed recently
+  Degraded,       // Link fault not yet recovered from
+  COUNT,
+};
+
+const char *s21_poll_profile_to_string(S21PollProfile profile);
+
+// Interval in cycles per poll query (columns follow S21_POLL_QUERIES) for
+// each profile. 0 skips the query, S21_PROFILE_KEEP keeps the query plan's.
+static const uint8_t S21_PROFILE_KEEP = 0xFF;
+struct S21PollProfiles {
+  uint8_t interval[(size_t) S21PollProfile::COUNT][S21_POLL_QUERY_COUNT];
+};
+
+// clang-format off
+static const S21PollProfiles S21_DEFAULT_POLL_PROFILES = {{
+  //  F1  F5  Rd  F9  RH  RI  Ra  RL
+  {S21_PROFILE_KEEP, S21_PROFILE_KEEP, S21_PROFILE_KEEP, S21_PROFILE_KEEP,
+   S21_PROFILE_KEEP, S21_PROFILE_KEEP, S21_PROFILE_KEEP, S21_PROFILE_KEEP},
+  // Off: nothing moves, only room and outside temperatures matter.
+  {S21_PROFILE_KEEP, 5, 0, 5, 5, 0, 5, 0},
+  // Transitioning: follow compressor, coil and fan closely.
+  {1, 1, 1, S21_PROFILE_KEEP, S21_PROFILE_KEEP, 1, S21_PROFILE_KEEP, 1},
+  // Degraded: core state only, until the link is clean again.
+  {S21_PROFILE_KEEP, S21_PROFILE_KEEP, S21_PROFILE_KEEP, 0, 0, 0, 0, 0},
+}};
+// clang-format on
+
+// Per-query figures from run_benchmark().
+struct S21BenchmarkResult {
+  const char *code;
+  uint16_t min_ms;
+  uint16_t median_ms;
+  uint16_t max_ms;
+  uint8_t runs;
+  uint8_t failures;
+};
+
+// What the unit told us about itself during negotiation. Stored in
+// preferences so later boots can skip straight to polling.
+struct S21ProtocolInfo {
+  uint8_t major;
+  char version[5];     // FY00 reply as sent, protocol 3 and up only
+  char model[5];       // M reply as sent
+  uint16_t supported;  // Bit per S21_POLL_QUERIES entry
+};
+
+// Known deviations from the protocol, per model code (the M reply). Units
+// with a listed model skip probing and use the quirks directly; any other
+// unit is probed and gets the fallback entry.
+struct S21ModelQuirks {
+  const char *model;  // nullptr for the fallback entry, which must be last
+  // Response whose checksum is consistently off, and by how much.
+  char checksum_code[2];
+  uint8_t checksum_offset;
+  // S21_POLL_QUERIES bits the model doesn't answer.
+  uint16_t unsupported;
+  // Response frame timeout (ms), 0 for S21_RESPONSE_TIMEOUT.
+  uint16_t response_timeout;
+};
+
+// clang-format off
+static const S21ModelQuirks S21_MODEL_QUIRKS[] = {
+    // Some units reply to F9 with a checksum two more than the sum; which
+    // ones isn't known, so the fallback keeps accepting it.
+    {nullptr, {'G', '9'}, 2, 0, 0},
+};
+// clang-format on
+
+const S21ModelQuirks *s21_find_model_quirks(const char *model);
+
+// Bytes after the D1/D5 code.
+static const size_t S21_COMMAND_PAYLOAD_SIZE = 4;
+
+// Latest desired state for one command type. A command carries the full
+// state, so sending it again is harmless: a newer request simply replaces
+// the pending one and the journal keeps retrying until the unit confirms
+// it or the deadline passes.
+struct S21JournalEntry {
+  bool active = false;     // Not yet confirmed or given up on
+  bool in_flight = false;  // An attempt is queued, sent or being confirmed
+  uint8_t payload[S21_COMMAND_PAYLOAD_SIZE];
+  uint8_t generation = 0;  // Bumped whenever the payload is replaced
+  uint8_t attempts = 0;
+  uint32_t start = 0;      // When the current payload was requested
+};
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define USE_DAIKIN_S21_COROUTINES
+class S21Awaitable;
+class S21Delay;
+#endif
+
+class S21OutdoorGroup;
+
 class DaikinS21 : public PollingComponent {
  public:
   void update() override;
+  void loop() override;
   void dump_config() override;
   void set_uarts(uart::UARTComponent *tx, uart::UARTComponent *rx);
   void set_debug_protocol(bool set) { this->debug_protocol = set; }
+  // Keys the cached protocol info, so several units don't share it.
+  void set_component_id(const char *id) { this->component_id = id; }
+#ifdef USE_DAIKIN_S21_METRICS
+  void set_metrics(web_server_base::WebServerBase *base, const char *path,
+                   const char *unit) {
+    this->metrics_base = base;
+    this->metrics_path = path;
+    this->metrics_unit = unit;
+  }
+#endif
+#ifdef USE_DAIKIN_S21_BEACON
+  void set_beacon(const std::string &address, uint16_t port,
+                  uint32_t heartbeat_ms, uint8_t ttl, const char *node,
+                  const char *unit);
+#endif
+#ifdef USE_DAIKIN_S21_TIME_ALIGN
+  // Once the clock is valid, start poll cycles on wall-clock multiples of
+  // the update interval, shifted by phase_offset_ms.
+  void set_time_alignment(time::RealTimeClock *clock,
+                          uint32_t phase_offset_ms) {
+    this->clock = clock;
+    this->phase_offset_ms = phase_offset_ms;
+  }
+  bool is_time_aligned() { return this->time_aligned; }
+  // Index of the interval_ms wide wall-clock slot (shifted by the phase
+  // offset) that the latest aligned poll cycle was started for.
+  uint64_t get_cycle_slot(uint32_t interval_ms) {
+    return (this->cycle_boundary_ms - this->phase_offset_ms) / interval_ms;
+  }
+#endif
+  void setup() override;
   bool is_ready() { return this->ready; }
+  bool is_negotiated() { return this->negotiated; }
+  const S21ProtocolInfo &get_protocol_info() { return this->protocol; }
+  // Forget the cached protocol info and negotiate again on the next update.
+  void renegotiate();
+  // Stop all bus traffic (e.g. during OTA), holding the last known state.
+  void suspend();
+  // Resume polling, starting with an immediate F1 resync.
+  void resume();
+  bool is_suspended() { return this->suspended; }
+  // Changes the schedule of one poll query. Takes effect, and is saved, at
+  // the start of the next poll cycle. False for an unknown code.
+  bool set_query_schedule(const std::string &code, optional<uint8_t> interval,
+                          optional<uint8_t> priority, optional<bool> enabled);
+  const S21QueryPlan &get_query_plan() { return this->query_plan; }
+  // Share outdoor readings (Ra) with the other indoor units of a
+  // multi-split; only one member polls them at a time.
+  void set_outdoor_group(S21OutdoorGroup *group);
+  bool polls_outdoor();
+  bool group_outdoor_fresh();
+  void set_profile_interval(S21PollProfile profile, const char *code,
+                            uint8_t interval);
+  S21PollProfile get_poll_profile() { return this->profile; }
+  // Sends each polled query rounds times back to back, with regular polling
+  // paused, and reports latency and failures per query. False if one is
+  // already running or the protocol isn't negotiated yet.
+  bool run_benchmark(uint8_t rounds);
+  bool is_benchmarking() { return this->benchmarking; }
+  const std::vector<S21BenchmarkResult> &get_benchmark_results() {
+    return this->bench_results;
+  }
+  // Called with a compact JSON summary once a benchmark finishes.
+  void add_on_benchmark_callback(
+      std::function<void(const std::string &)> &&callback) {
+    this->benchmark_callback_.add(std::move(callback));
+  }
+  const DaikinS21Stats &get_stats() { return this->stats; }
+  void dump_trace();
+  const S21Tracer &get_tracer() { return this->tracer; }
 
   bool is_power_on() { return this->power_on; }
   DaikinClimateMode get_climate_mode() { return this->mode; }
@@ -46,7 +373,37 @@ class DaikinS21 : public PollingComponent {
   void set_daikin_climate_settings(bool power_on, DaikinClimateMode mode,
                                    float setpoint, DaikinFanMode fan_mode);
   void set_swing_settings(bool swing_v, bool swing_h);
-  bool send_cmd(std::vector<uint8_t> code, std::vector<uint8_t> payload);
+  // Full state in one go: D1 and D5 back to back, confirmed together.
+  void set_state(bool power_on, DaikinClimateMode mode, float setpoint,
+                 DaikinFanMode fan_mode, bool swing_v, bool swing_h);
+  // Transactions are queued and run from loop(); done is called with the
+  // outcome. Returns false if the queue is full.
+  bool send_cmd(std::vector<uint8_t> code, std::vector<uint8_t> payload,
+                S21Callback done);
+  bool query(const std::string &code, S21Callback done);
+  // Calls done once everything queued so far has completed.
+  bool sync(std::function<void()> &&done);
+#ifdef USE_DAIKIN_S21_COROUTINES
+  // Coroutine flavour: co_await s21->query("F1")
+  S21Awaitable query(const std::string &code);
+  S21Awaitable command(const std::string &code, std::vector<uint8_t> payload);
+  S21Delay sleep(uint32_t ms);
+  friend class S21Delay;
+#endif
+  // How long each command attempt waits for F1/F5 to reflect it.
+  void set_confirm_timeout(uint32_t ms) { this->confirm_timeout = ms; }
+  // Notified at the end of every poll cycle.
+  void add_on_cycle_callback(std::function<void()> &&callback) {
+    this->cycle_callback_.add(std::move(callback));
+  }
+  // Notified when a command has been confirmed (or given up on).
+  void add_on_command_callback(std::function<void()> &&callback) {
+    this->command_callback_.add(std::move(callback));
+  }
+  bool is_command_pending();
+  // Outcome of the command that most recently finished.
+  bool last_command_confirmed() { return this->last_confirmed; }
+  S21Command last_command() { return this->last_cmd; }
 
   float get_temp_inside() { return this->temp_inside / 10.0; }
   float get_temp_outside() { return this->temp_outside / 10.0; }
@@ -57,19 +414,196 @@ class DaikinS21 : public PollingComponent {
   bool get_swing_v() { return this->swing_v; }
 
  protected:
-  bool read_frame(std::vector<uint8_t> &payload);
-  void write_frame(std::vector<uint8_t> payload);
-  bool s21_query(std::vector<uint8_t> code);
+  enum class EngineState : uint8_t {
+    Idle,
+    WaitAck,
+    WaitFrame,
+  };
+
+  bool enqueue(const uint8_t *frame, size_t len, size_t code_len,
+               bool is_query, S21Callback &&done);
+  void start_transaction();
+  void finish_transaction(S21Result result);
+  void handle_ack();
+  void handle_frame();
+  void write_frame(const uint8_t *frame, size_t len);
   bool parse_response(std::vector<uint8_t> rcode, std::vector<uint8_t> payload);
-  bool run_queries(std::vector<std::string> queries);
+  void run_queries(std::vector<std::string> queries);
+  void poll(bool core);
+  void negotiate();
+  void finish_negotiation(bool ok);
+  void select_plan();
+  void load_query_plan();
+  void select_profile();
+  void apply_query_plan();
+  void save_protocol_info();
+  void log_protocol_info();
+  void finish_cycle();
+  void benchmark_next();
+  void benchmark_step(uint8_t remaining);
+  void benchmark_done();
+  bool stage(S21Command cmd, const uint8_t *payload);
+  void submit(S21Command cmd, const uint8_t *payload);
+  uint8_t start_attempt(S21Command cmd);
+  void attempt(S21Command cmd);
+  void attempt_state();
+  void attempt_done(S21Command cmd, uint8_t generation, bool confirmed);
+  bool state_matches(S21Command cmd, const uint8_t *payload);
+  bool state_matches(S21Command cmd) {
+    return this->state_matches(cmd, this->journal[(size_t) cmd].payload);
+  }
+  void confirm(std::vector<const char *> queries, std::function<bool()> &&check,
+               uint32_t until, std::function<void(bool)> &&done);
+  void command_done(S21Command cmd, bool confirmed);
+  void record_transaction(uint32_t start);
+  void learn_frame_gap(S21Result result);
+#ifdef USE_DAIKIN_S21_TIME_ALIGN
+  void track_clock();
+  uint64_t wall_ms();
+  uint32_t ms_to_aligned_cycle(uint32_t min_ms);
+  void schedule_aligned_cycle();
+#endif
+  void trace(S21TraceEvent event, const uint8_t *data = nullptr,
+             size_t len = 0) {
+    this->trace_buffer.add(millis(), event, data, len);
+  }
+  // Compiles away unless built with S21_TRACING.
+  void trace_point(S21TracePoint point) {
+    if constexpr (S21Tracer::enabled) {
+      const S21Transaction &txn = this->queue[this->queue_head];
+      this->tracer.point(point, micros(), txn.frame,
+                         this->queue_len > 0 ? txn.code_len : 0);
+    }
+  }
+  void trace_junk(uint8_t byte);
+  void climate_payload(uint8_t *out, bool power_on, DaikinClimateMode mode,
+                       float setpoint, DaikinFanMode fan_mode);
+  void swing_payload(uint8_t *out, bool swing_v, bool swing_h);
+#ifdef S21_DIFFERENTIAL
+  S21DecodedState decoded_state() const;
+  void check_frame(s21_protocol::FrameResult result);
+  bool check_decode(const std::vector<uint8_t> &rcode,
+                    const std::vector<uint8_t> &payload);
+  void check_command(S21Command cmd, const uint8_t *payload,
+                     const uint8_t *reference);
+  void log_differential();
+#endif
+  bool note_warning(S21Warning w) { return this->warnings.note(w); }
+  void log_warning_summary();
   void dump_state();
   void check_uart_settings();
+#ifdef USE_DAIKIN_S21_BEACON
+  void send_beacon();
+#endif
 
   uart::UARTComponent *tx_uart{nullptr};
   uart::UARTComponent *rx_uart{nullptr};
   bool ready = false;
+  bool negotiated = false;
+  const char *component_id{""};
+  ESPPreferenceObject protocol_pref;
+  S21ProtocolInfo protocol{};
+  const S21ModelQuirks *quirks{nullptr};
+  // Bit per S21_POLL_QUERIES entry actually polled each cycle.
+  uint16_t plan = 0;
+  // Consecutive NAKs per poll query; a query that keeps being rejected is
+  // dropped from the plan.
+  uint8_t poll_naks[S21_POLL_QUERY_COUNT] = {};
+  // Schedule in use, and changes waiting for the next cycle boundary.
+  S21QueryPlan query_plan;
+  S21QueryPlan next_query_plan;
+  bool query_plan_changed = false;
+  ESPPreferenceObject query_plan_pref;
+  // S21_POLL_QUERIES indices by priority.
+  uint8_t poll_order[S21_POLL_QUERY_COUNT];
+  uint32_t cycle_count = 0;
+  S21OutdoorGroup *outdoor_group{nullptr};
+  S21PollProfiles profiles = S21_DEFAULT_POLL_PROFILES;
+  S21PollProfile profile = S21PollProfile::Running;
+  uint32_t last_transition = 0;
+  bool suspended = false;
   bool debug_protocol = false;
 
+  S21Transaction queue[S21_QUEUE_SIZE];
+  size_t queue_head = 0;
+  size_t queue_len = 0;
+  EngineState state = EngineState::Idle;
+  uint32_t txn_start = 0;
+  // End of the last transaction, clean ones since the gap last changed, and
+  // the largest gap that has failed so far.
+  uint32_t txn_end = 0;
+  uint16_t gap_clean = 0;
+  uint16_t gap_failed = 0;
+  uint32_t state_start = 0;
+  // Bytes read waiting for the current response, and stray bytes seen
+  // during the current transaction. Both bound the work done on noise.
+  size_t rx_bytes = 0;
+  size_t junk_bytes = 0;
+  bool cycle_active = false;
+  bool cycle_ok = false;
+  // No timeout or garbled frame during the current cycle.
+  bool cycle_link_ok = false;
+  // Set on a failed transaction until the next clean poll cycle.
+  bool link_faulted = false;
+  uint32_t fault_start = 0;
+  S21JournalEntry journal[(size_t) S21Command::COUNT];
+  uint32_t confirm_timeout = 5000;
+  S21Command last_cmd = S21Command::Climate;
+  bool last_confirmed = false;
+  CallbackManager<void()> command_callback_;
+  CallbackManager<void()> cycle_callback_;
+  bool benchmarking = false;
+  uint8_t bench_rounds = 0;
+  size_t bench_query = 0;  // Index into S21_POLL_QUERIES
+  uint8_t bench_failures = 0;
+  std::vector<uint16_t> bench_samples;
+  std::vector<S21BenchmarkResult> bench_results;
+  CallbackManager<void(const std::string &)> benchmark_callback_;
+  HighFrequencyLoopRequester high_freq;
+
+  DaikinS21Stats stats;
+  s21_protocol::FrameAssembler assembler;
+  S21TraceBuffer trace_buffer;
+  S21Tracer tracer;
+#ifdef S21_DIFFERENTIAL
+  // Raw bytes of the response being read, for the reference frame reader.
+  std::vector<uint8_t> diff_rx;
+  S21DifferentialStats diff_stats;
+#endif
+  S21WarningCounter warnings;
+  uint32_t warnings_since = 0;
+#ifdef USE_DAIKIN_S21_METRICS
+  web_server_base::WebServerBase *metrics_base{nullptr};
+  const char *metrics_path{nullptr};
+  const char *metrics_unit{nullptr};
+#endif
+#ifdef USE_DAIKIN_S21_TIME_ALIGN
+  time::RealTimeClock *clock{nullptr};
+  uint32_t phase_offset_ms = 0;
+  bool time_aligned = false;
+  // Last wall-clock second seen and millis() when it started, giving
+  // sub-second wall-clock time without an RTC.
+  time_t clock_second = 0;
+  uint32_t clock_second_ms = 0;
+  bool clock_valid = false;
+  // Wall-clock boundaries of the next scheduled and the latest aligned cycle.
+  uint64_t next_boundary_ms = 0;
+  uint64_t cycle_boundary_ms = 0;
+#endif
+#ifdef USE_DAIKIN_S21_BEACON
+  std::unique_ptr<socket::Socket> beacon_socket;
+  std::string beacon_address;
+  uint16_t beacon_port = 0;
+  uint8_t beacon_ttl = 1;
+  struct sockaddr_storage beacon_addr;
+  socklen_t beacon_addrlen = 0;
+  uint32_t beacon_heartbeat_ms = 0;
+  uint32_t beacon_node_id = 0;
+  const char *beacon_node{nullptr};
+  uint32_t last_beacon_ms = 0;
+  S21Beacon last_beacon;
+#endif
+
   bool power_on = false;
   DaikinClimateMode mode = DaikinClimateMode::Disabled;
   DaikinFanMode fan = DaikinFanMode::Auto;
@@ -83,13 +617,78 @@ class DaikinS21 : public PollingComponent {
   bool idle = true;
 };
 
+// Indoor units on one outdoor unit. Ownership of the outdoor queries
+// rotates to the next capable member after each reading, so a member that
+// drops off only delays the value until another one takes over; a reading
+// older than the stale limit lets any member poll.
+class S21OutdoorGroup {
+ public:
+  void add_member(DaikinS21 *member) { this->members.push_back(member); }
+  bool should_poll(DaikinS21 *member);
+  void publish(int16_t temp_outside);
+  bool has_value() { return this->updated != 0; }
+  int16_t get_temp_outside() { return this->temp_outside; }
+  // Time of the last reading, in millis().
+  uint32_t get_updated() { return this->updated; }
+  size_t size() { return this->members.size(); }
+
+ protected:
+  std::vector<DaikinS21 *> members;
+  size_t owner = 0;
+  int16_t temp_outside = 0;
+  uint32_t updated = 0;
+};
+
 class DaikinS21Client {
  public:
   void set_s21(DaikinS21 *s21) { this->s21 = s21; }
 
  protected:
+  // Once the master's poll cycles are aligned to the clock, stops client's
+  // own poller and calls its update() right after the cycle started on each
+  // wall-clock multiple of its update interval, so its samples line up too.
+#ifdef USE_DAIKIN_S21_TIME_ALIGN
+  void align_updates(PollingComponent *client);
+#else
+  void align_updates(PollingComponent *) {}
+#endif
+
   DaikinS21 *s21;
+#ifdef USE_DAIKIN_S21_TIME_ALIGN
+  bool updates_aligned = false;
+  uint64_t update_slot = 0;
+#endif
+};
+
+template<typename... Ts>
+class SetQueryAction : public Action<Ts...>, public Parented<DaikinS21> {
+ public:
+  TEMPLATABLE_VALUE(std::string, code)
+  TEMPLATABLE_VALUE(uint8_t, interval)
+  TEMPLATABLE_VALUE(uint8_t, priority)
+  TEMPLATABLE_VALUE(bool, enabled)
+
+  void play(Ts... x) override {
+    this->parent_->set_query_schedule(this->code_.value(x...),
+                                      this->interval_.optional_value(x...),
+                                      this->priority_.optional_value(x...),
+                                      this->enabled_.optional_value(x...));
+  }
+};
+
+template<typename... Ts>
+class BenchmarkAction : public Action<Ts...>, public Parented<DaikinS21> {
+ public:
+  TEMPLATABLE_VALUE(uint8_t, rounds)
+
+  void play(Ts... x) override {
+    this->parent_->run_benchmark(this->rounds_.value(x...));
+  }
 };
 
 }  // namespace daikin_s21
 }  // namespace esphome
+
+#ifdef USE_DAIKIN_S21_COROUTINES
+#include "s21_coro.h"
+#endif
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+// Fixed-layout state beacon multicast by each daikin_s21 node. This header
+// has no ESPHome dependencies so host tools can share the layout.
+//
+// All multi-byte fields are little endian.
+//
+//  off size field
+//    0    4 magic "S21B"
+//    4    1 version (S21_BEACON_VERSION)
+//    5    1 flags (S21_BEACON_FLAG_*)
+//    6    1 mode (DaikinClimateMode character)
+//    7    1 fan (DaikinFanMode character)
+//    8    4 node id (fnv1 hash of node name and component id)
+//   12    4 sequence number
+//   16    2 setpoint (0.1 C)
+//   18    2 inside temperature (0.1 C)
+//   20    2 outside temperature (0.1 C)
+//   22    2 coil temperature (0.1 C)
+//   24    2 fan rpm
+//   26    2 reserved
+//   28    4 transactions
+//   32    4 NAKs
+//   36    4 timeouts
+//   40    4 checksum errors
+//   44    4 uptime (s)
+//   48   16 node name, NUL padded
+
+namespace esphome {
+namespace daikin_s21 {
+
+static const uint8_t S21_BEACON_VERSION = 1;
+static const size_t S21_BEACON_SIZE = 64;
+static const size_t S21_BEACON_NAME_SIZE = 16;
+
+static const uint8_t S21_BEACON_FLAG_POWER = 1 << 0;
+static const uint8_t S21_BEACON_FLAG_IDLE = 1 << 1;
+static const uint8_t S21_BEACON_FLAG_SWING_V = 1 << 2;
+static const uint8_t S21_BEACON_FLAG_SWING_H = 1 << 3;
+static const uint8_t S21_BEACON_FLAG_READY = 1 << 4;
+static const uint8_t S21_BEACON_FLAG_HEARTBEAT = 1 << 5;
+
+// Temperature change (0.1 C) that is sent without waiting for a heartbeat.
+static const int16_t S21_BEACON_TEMP_STEP = 10;
+
+struct S21Beacon {
+  uint8_t flags = 0;
+  uint8_t mode = 0;
+  uint8_t fan = 0;
+  uint32_t node_id = 0;
+  uint32_t seq = 0;
+  int16_t setpoint = 0;
+  int16_t temp_inside = 0;
+  int16_t temp_outside = 0;
+  int16_t temp_coil = 0;
+  uint16_t fan_rpm = 0;
+  uint32_t transactions = 0;
+  uint32_t naks = 0;
+  uint32_t timeouts = 0;
+  uint32_t checksum_errors = 0;
+  uint32_t uptime_s = 0;
+  char name[S21_BEACON_NAME_SIZE + 1] = {};
+
+  // True if the control state differs, or the inside or outside temperature
+  // moved by S21_BEACON_TEMP_STEP or more. Coil temperature, fan rpm and
+  // counters alone don't warrant a beacon; heartbeats carry them.
+  bool state_differs(const S21Beacon &other) const {
+    const uint8_t mask = ~S21_BEACON_FLAG_HEARTBEAT;
+    return (this->flags & mask) != (other.flags & mask) ||
+           this->mode != other.mode || this->fan != other.fan ||
+           this->setpoint != other.setpoint ||
+           abs(this->temp_inside - other.temp_inside) >= S21_BEACON_TEMP_STEP ||
+           abs(this->temp_outside - other.temp_outside) >= S21_BEACON_TEMP_STEP;
+  }
+};
+
+inline void s21_beacon_put16(uint8_t *p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+inline void s21_beacon_put32(uint8_t *p, uint32_t v) {
+  s21_beacon_put16(p, v & 0xFFFF);
+  s21_beacon_put16(p + 2, v >> 16);
+}
+
+inline uint16_t s21_beacon_get16(const uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+
+inline uint32_t s21_beacon_get32(const uint8_t *p) {
+  return s21_beacon_get16(p) | ((uint32_t) s21_beacon_get16(p + 2) << 16);
+}
+
+// Encodes into buf, which must hold S21_BEACON_SIZE bytes.
+inline void encode_s21_beacon(const S21Beacon &b, uint8_t *buf) {
+  memcpy(buf, "S21B", 4);
+  buf[4] = S21_BEACON_VERSION;
+  buf[5] = b.flags;
+  buf[6] = b.mode;
+  buf[7] = b.fan;
+  s21_beacon_put32(buf + 8, b.node_id);
+  s21_beacon_put32(buf + 12, b.seq);
+  s21_beacon_put16(buf + 16, b.setpoint);
+  s21_beacon_put16(buf + 18, b.temp_inside);
+  s21_beacon_put16(buf + 20, b.temp_outside);
+  s21_beacon_put16(buf + 22, b.temp_coil);
+  s21_beacon_put16(buf + 24, b.fan_rpm);
+  s21_beacon_put16(buf + 26, 0);
+  s21_beacon_put32(buf + 28, b.transactions);
+  s21_beacon_put32(buf + 32, b.naks);
+  s21_beacon_put32(buf + 36, b.timeouts);
+  s21_beacon_put32(buf + 40, b.checksum_errors);
+  s21_beacon_put32(buf + 44, b.uptime_s);
+  memset(buf + 48, 0, S21_BEACON_NAME_SIZE);
+  memcpy(buf + 48, b.name, strnlen(b.name, S21_BEACON_NAME_SIZE));
+}
+
+inline bool decode_s21_beacon(const uint8_t *buf, size_t len, S21Beacon *b) {
+  if (len < S21_BEACON_SIZE || memcmp(buf, "S21B", 4) != 0 ||
+      buf[4] != S21_BEACON_VERSION) {
+    return false;
+  }
+  b->flags = buf[5];
+  b->mode = buf[6];
+  b->fan = buf[7];
+  b->node_id = s21_beacon_get32(buf + 8);
+  b->seq = s21_beacon_get32(buf + 12);
+  b->setpoint = s21_beacon_get16(buf + 16);
+  b->temp_inside = s21_beacon_get16(buf + 18);
+  b->temp_outside = s21_beacon_get16(buf + 20);
+  b->temp_coil = s21_beacon_get16(buf + 22);
+  b->fan_rpm = s21_beacon_get16(buf + 24);
+  b->transactions = s21_beacon_get32(buf + 28);
+  b->naks = s21_beacon_get32(buf + 32);
+  b->timeouts = s21_beacon_get32(buf + 36);
+  b->checksum_errors = s21_beacon_get32(buf + 40);
+  b->uptime_s = s21_beacon_get32(buf + 44);
+  memcpy(b->name, buf + 48, S21_BEACON_NAME_SIZE);
+  b->name[S21_BEACON_NAME_SIZE] = '\0';
+  return true;
+}
+
+}  // namespace daikin_s21
+}  // namespace esphome
@@ -0,0 +1,101 @@
+#pragma once
+
+// C++20 coroutine wrappers around the DaikinS21 transaction queue, so
+// multi-step interactions read as straight-line code:
+//
+//   S21Task resync(DaikinS21 *s21) {
+//     if (co_await s21->command("D1", payload) != S21Result::Ok)
+//       co_return;
+//     for (int i = 0; i < 8; i++) {
+//       co_await s21->query("F1");
+//       if (confirmed(s21))
+//         break;
+//       co_await s21->sleep(250);
+//     }
+//   }
+//
+// Every co_await yields back to the main loop; nothing blocks. Only
+// available when the toolchain supports coroutines (included by s21.h).
+
+#include <coroutine>
+#include "s21.h"
+
+namespace esphome {
+namespace daikin_s21 {
+
+// Fire-and-forget coroutine: starts eagerly and frees itself when done.
+struct S21Task {
+  struct promise_type {
+    S21Task get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() {}
+  };
+};
+
+// Awaits one queued transaction. The request is copied into the queue
+// slot, so the awaitable only has to live until it resumes.
+class S21Awaitable {
+ public:
+  S21Awaitable(DaikinS21 *s21, std::vector<uint8_t> code,
+               std::vector<uint8_t> payload, bool is_query)
+      : s21(s21),
+        code(std::move(code)),
+        payload(std::move(payload)),
+        is_query(is_query) {}
+
+  bool await_ready() const noexcept { return false; }
+  bool await_suspend(std::coroutine_handle<> handle) {
+    auto done = [this, handle](S21Result result) {
+      this->result = result;
+      handle.resume();
+    };
+    bool queued =
+        this->is_query
+            ? this->s21->query(std::string(this->code.begin(), this->code.end()),
+                               done)
+            : this->s21->send_cmd(this->code, this->payload, done);
+    // Queue full: resume straight away with an error.
+    return queued;
+  }
+  S21Result await_resume() const noexcept { return this->result; }
+
+ protected:
+  DaikinS21 *s21;
+  std::vector<uint8_t> code;
+  std::vector<uint8_t> payload;
+  bool is_query;
+  S21Result result = S21Result::Error;
+};
+
+class S21Delay {
+ public:
+  S21Delay(DaikinS21 *s21, uint32_t ms) : s21(s21), ms(ms) {}
+
+  bool await_ready() const noexcept { return this->ms == 0; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    this->s21->set_timeout(this->ms, [handle]() { handle.resume(); });
+  }
+  void await_resume() const noexcept {}
+
+ protected:
+  DaikinS21 *s21;
+  uint32_t ms;
+};
+
+inline S21Awaitable DaikinS21::query(const std::string &code) {
+  return S21Awaitable(this, std::vector<uint8_t>(code.begin(), code.end()), {},
+                      true);
+}
+
+inline S21Awaitable DaikinS21::command(const std::string &code,
+                                       std::vector<uint8_t> payload) {
+  return S21Awaitable(this, std::vector<uint8_t>(code.begin(), code.end()),
+                      std::move(payload), false);
+}
+
+inline S21Delay DaikinS21::sleep(uint32_t ms) { return S21Delay(this, ms); }
+
+}  // namespace daikin_s21
+}  // namespace esphome
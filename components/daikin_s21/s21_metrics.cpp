@@ -0,0 +1,27 @@
+#include "s21_metrics.h"
+
+#ifdef USE_DAIKIN_S21_METRICS
+
+namespace esphome {
+namespace daikin_s21 {
+
+void DaikinS21MetricsHandler::handleRequest(AsyncWebServerRequest *req) {
+#ifdef S21_TRACING
+  if (req->url() == this->trace_path.c_str()) {
+    AsyncResponseStream *stream = req->beginResponseStream("application/json");
+    this->s21->get_tracer().write_json(stream);
+    req->send(stream);
+    return;
+  }
+#endif
+  AsyncResponseStream *stream =
+      req->beginResponseStream("text/plain; version=0.0.4; charset=utf-8");
+  PrometheusWriter<AsyncResponseStream> writer(stream, this->unit);
+  write_prometheus_metrics(writer, this->s21->get_stats());
+  req->send(stream);
+}
+
+}  // namespace daikin_s21
+}  // namespace esphome
+
+#endif
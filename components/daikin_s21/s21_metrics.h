@@ -0,0 +1,205 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstdio>
+#include "esphome/core/defines.h"
+#include "s21.h"
+
+namespace esphome {
+namespace daikin_s21 {
+
+// Streams Prometheus text exposition format straight into any sink with a
+// print(const char *) method (e.g. AsyncResponseStream). Numbers are
+// formatted into a small stack buffer; no intermediate strings are built.
+template<typename Stream> class PrometheusWriter {
+ public:
+  PrometheusWriter(Stream *out, const char *unit) : out(out), unit(unit) {}
+
+  void header(const char *name, const char *type, const char *help) {
+    this->out->print("# HELP daikin_s21_");
+    this->out->print(name);
+    this->out->print(" ");
+    this->out->print(help);
+    this->out->print("\n# TYPE daikin_s21_");
+    this->out->print(name);
+    this->out->print(" ");
+    this->out->print(type);
+    this->out->print("\n");
+  }
+
+  void sample(const char *name, uint32_t value, const char *le = nullptr) {
+    char buf[12];
+    snprintf(buf, sizeof(buf), "%" PRIu32, value);
+    this->sample_raw(name, buf, le);
+  }
+
+  // Milliseconds rendered as seconds, without going through float.
+  void sample_ms(const char *name, uint32_t ms, const char *le = nullptr) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%" PRIu32 ".%03" PRIu32, ms / 1000, ms % 1000);
+    this->sample_raw(name, buf, le);
+  }
+
+  // Extra label (e.g. command="D1") added to the following samples, or
+  // nullptr for none.
+  void set_label(const char *label) { this->label = label; }
+
+  void counter(const char *name, const char *help, uint32_t value) {
+    this->header(name, "counter", help);
+    this->sample(name, value);
+  }
+
+  void histogram_ms(const char *name, const char *help, const uint16_t *bounds,
+                    const uint32_t *buckets, size_t count, uint32_t sum_ms) {
+    this->header(name, "histogram", help);
+    this->histogram_samples_ms(name, bounds, buckets, count, sum_ms);
+  }
+
+  // Samples of one histogram series; the header is written separately so
+  // several labelled series can share it.
+  void histogram_samples_ms(const char *name, const uint16_t *bounds,
+                            const uint32_t *buckets, size_t count,
+                            uint32_t sum_ms) {
+    char le[16];
+    char bucket_name[48];
+    snprintf(bucket_name, sizeof(bucket_name), "%s_bucket", name);
+    uint32_t cumulative = 0;
+    for (size_t i = 0; i < count; i++) {
+      cumulative += buckets[i];
+      snprintf(le, sizeof(le), "%u.%03u", bounds[i] / 1000, bounds[i] % 1000);
+      this->sample(bucket_name, cumulative, le);
+    }
+    cumulative += buckets[count];
+    this->sample(bucket_name, cumulative, "+Inf");
+    snprintf(bucket_name, sizeof(bucket_name), "%s_sum", name);
+    this->sample_ms(bucket_name, sum_ms);
+    snprintf(bucket_name, sizeof(bucket_name), "%s_count", name);
+    this->sample(bucket_name, cumulative);
+  }
+
+ protected:
+  void sample_raw(const char *name, const char *value, const char *le) {
+    this->out->print("daikin_s21_");
+    this->out->print(name);
+    this->out->print("{unit=\"");
+    this->out->print(this->unit);
+    this->out->print("\"");
+    if (this->label != nullptr) {
+      this->out->print(",");
+      this->out->print(this->label);
+    }
+    if (le != nullptr) {
+      this->out->print(",le=\"");
+      this->out->print(le);
+      this->out->print("\"");
+    }
+    this->out->print("} ");
+    this->out->print(value);
+    this->out->print("\n");
+  }
+
+  Stream *out;
+  const char *unit;
+  const char *label{nullptr};
+};
+
+template<typename Stream>
+void write_prometheus_metrics(PrometheusWriter<Stream> &w,
+                              const DaikinS21Stats &stats) {
+  w.counter("transactions_total", "S21 queries and commands sent.",
+            stats.transactions);
+  w.counter("naks_total", "Transactions rejected with NAK.", stats.naks);
+  w.counter("timeouts_total", "Transactions that timed out.", stats.timeouts);
+  w.counter("checksum_errors_total", "Frames received with a bad checksum.",
+            stats.checksum_errors);
+  w.counter("decode_errors_total", "Responses that could not be decoded.",
+            stats.decode_errors);
+  w.counter("d1_writes_total", "Acknowledged D1 (basic climate) commands.",
+            stats.d1_writes);
+  w.histogram_ms("transaction_latency_seconds",
+                 "Time from frame start to transaction completion.",
+                 S21_LATENCY_BUCKETS_MS, stats.latency_buckets,
+                 S21_LATENCY_BUCKET_COUNT, stats.latency_sum_ms);
+  w.header("bus_busy_seconds_total", "counter",
+           "Time with a transaction in flight; rate() is bus utilisation.");
+  w.sample_ms("bus_busy_seconds_total", stats.bus_busy_ms);
+  w.header("frame_gap_seconds", "gauge",
+           "Learned quiet time enforced between transactions.");
+  w.sample_ms("frame_gap_seconds", stats.frame_gap_ms);
+
+  char label[16];
+  w.header("command_latency_seconds", "histogram",
+           "Time from a command being issued to the unit confirming it.");
+  for (size_t i = 0; i < (size_t) S21Command::COUNT; i++) {
+    const S21CommandStats &cs = stats.commands[i];
+    snprintf(label, sizeof(label), "command=\"%s\"",
+             s21_command_to_code((S21Command) i));
+    w.set_label(label);
+    w.histogram_samples_ms("command_latency_seconds",
+                           S21_COMMAND_LATENCY_BUCKETS_MS, cs.latency_buckets,
+                           S21_COMMAND_LATENCY_BUCKET_COUNT, cs.latency_sum_ms);
+  }
+  w.header("command_failures_total", "counter",
+           "Commands rejected or never confirmed by the unit.");
+  for (size_t i = 0; i < (size_t) S21Command::COUNT; i++) {
+    snprintf(label, sizeof(label), "command=\"%s\"",
+             s21_command_to_code((S21Command) i));
+    w.set_label(label);
+    w.sample("command_failures_total", stats.commands[i].failed);
+  }
+  w.header("command_retries_total", "counter",
+           "Command resends after a NAK, timeout or missing confirmation.");
+  for (size_t i = 0; i < (size_t) S21Command::COUNT; i++) {
+    snprintf(label, sizeof(label), "command=\"%s\"",
+             s21_command_to_code((S21Command) i));
+    w.set_label(label);
+    w.sample("command_retries_total", stats.commands[i].retries);
+  }
+  w.header("commands_coalesced_total", "counter",
+           "Commands replaced by a newer one before being confirmed.");
+  for (size_t i = 0; i < (size_t) S21Command::COUNT; i++) {
+    snprintf(label, sizeof(label), "command=\"%s\"",
+             s21_command_to_code((S21Command) i));
+    w.set_label(label);
+    w.sample("commands_coalesced_total", stats.commands[i].coalesced);
+  }
+  w.set_label(nullptr);
+  w.histogram_ms("recovery_seconds",
+                 "Time from a link fault to the next clean poll cycle.",
+                 S21_RECOVERY_BUCKETS_MS, stats.recovery_buckets,
+                 S21_RECOVERY_BUCKET_COUNT, stats.recovery_sum_ms);
+}
+
+#ifdef USE_DAIKIN_S21_METRICS
+class DaikinS21MetricsHandler : public AsyncWebHandler {
+ public:
+  DaikinS21MetricsHandler(DaikinS21 *s21, const char *path, const char *unit)
+      : s21(s21), path(path), unit(unit) {
+#ifdef S21_TRACING
+    this->trace_path = std::string(path) + "/trace.json";
+#endif
+  }
+
+  bool canHandle(AsyncWebServerRequest *request) override {
+    if (request->method() != HTTP_GET)
+      return false;
+#ifdef S21_TRACING
+    if (request->url() == this->trace_path.c_str())
+      return true;
+#endif
+    return request->url() == this->path;
+  }
+  void handleRequest(AsyncWebServerRequest *req) override;
+
+ protected:
+  DaikinS21 *s21;
+  const char *path;
+  const char *unit;
+#ifdef S21_TRACING
+  std::string trace_path;
+#endif
+};
+#endif
+
+}  // namespace daikin_s21
+}  // namespace esphome
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Plain reference versions of the frame reader, response decoder and
+// command encoders, written to be obviously right rather than fast. Built
+// with -DS21_DIFFERENTIAL, the engine runs them next to its own code on
+// every frame and command and logs any difference. No ESPHome dependencies,
+// so captures can be replayed through them on a host as well.
+
+namespace esphome {
+namespace daikin_s21 {
+
+// Everything the decoder can change, in wire units.
+struct S21DecodedState {
+  bool power_on = false;
+  uint8_t mode = 0;      // F1 mode character
+  int16_t setpoint = 0;  // Tenths of a degree C
+  uint8_t fan = 0;       // F1 fan character
+  bool swing_v = false;
+  bool swing_h = false;
+  int16_t temp_inside = 0;
+  int16_t temp_outside = 0;
+  int16_t temp_coil = 0;
+  uint16_t fan_rpm = 0;
+  bool idle = true;
+  uint8_t protocol_major = 0;
+
+  bool operator==(const S21DecodedState &o) const {
+    return this->power_on == o.power_on && this->mode == o.mode &&
+           this->setpoint == o.setpoint && this->fan == o.fan &&
+           this->swing_v == o.swing_v && this->swing_h == o.swing_h &&
+           this->temp_inside == o.temp_inside &&
+           this->temp_outside == o.temp_outside &&
+           this->temp_coil == o.temp_coil && this->fan_rpm == o.fan_rpm &&
+           this->idle == o.idle && this->protocol_major == o.protocol_major;
+  }
+  bool operator!=(const S21DecodedState &o) const { return !(*this == o); }
+
+  std::string to_string() const {
+    char buf[128];
+    snprintf(buf, sizeof(buf),
+             "power=%d mode=%02X sp=%d fan=%02X swing=%d%d in=%d out=%d "
+             "coil=%d rpm=%u idle=%d proto=%u",
+             this->power_on, this->mode, this->setpoint, this->fan,
+             this->swing_v, this->swing_h, this->temp_inside,
+             this->temp_outside, this->temp_coil, this->fan_rpm, this->idle,
+             this->protocol_major);
+    return buf;
+  }
+};
+
+enum class S21ReferenceFrame : uint8_t {
+  Frame,
+  ChecksumError,
+  None,
+};
+
+// Reads the frame ending at the last byte of everything received for a
+// transaction, ETX included. Only the bytes after the last STX count.
+inline S21ReferenceFrame s21_reference_unframe(
+    const std::vector<uint8_t> &bytes, std::vector<uint8_t> &payload) {
+  const uint8_t stx = 2;
+  const uint8_t etx = 3;
+  if (bytes.empty() || bytes.back() != etx)
+    return S21ReferenceFrame::None;
+  size_t start = bytes.size() - 1;
+  while (start > 0 && bytes[start - 1] != stx)
+    start--;
+  if (start == 0)
+    return S21ReferenceFrame::None;
+  // start is the first byte after STX; the checksum sits right before ETX.
+  size_t end = bytes.size() - 1;
+  if (end == start)
+    return S21ReferenceFrame::ChecksumError;
+  payload.assign(bytes.begin() + start, bytes.begin() + end - 1);
+  unsigned sum = 0;
+  for (uint8_t b : payload)
+    sum += b;
+  return (sum & 0xFF) == bytes[end - 1] ? S21ReferenceFrame::Frame
+                                        : S21ReferenceFrame::ChecksumError;
+}
+
+// Three digits, least significant first, then an optional sign:
+// "520+" is 25.
+inline int s21_reference_number(const std::string &p, bool with_sign) {
+  auto digit = [&p](size_t i) { return (uint8_t) p[i] - '0'; };
+  int value = digit(2) * 100 + digit(1) * 10 + digit(0);
+  return with_sign && p.size() > 3 && p[3] == '-' ? -value : value;
+}
+
+// Applies a response (code followed by payload) to state the way the
+// protocol describes it. Returns whether the response was understood.
+inline bool s21_reference_decode(const std::vector<uint8_t> &frame,
+                                 size_t code_len, S21DecodedState &state) {
+  if (frame.size() < code_len)
+    return false;
+  std::string code(frame.begin(), frame.begin() + code_len);
+  std::string p(frame.begin() + code_len, frame.end());
+  if (code == "M")
+    return true;  // Model name, not part of the state
+  if (code.size() < 2)
+    return false;
+  std::string c = code.substr(0, 2);
+  if (c == "G1" && p.size() >= 4) {
+    state.power_on = p[0] == '1';
+    state.mode = p[1];
+    state.setpoint = (int16_t) (((uint8_t) p[2] - 28) * 5);
+    state.fan = p[3];
+    return true;
+  }
+  if (c == "G5" && p.size() >= 1) {
+    state.swing_v = (p[0] & 1) != 0;
+    state.swing_h = (p[0] & 2) != 0;
+    return true;
+  }
+  if (c == "G8" && p.size() >= 2) {
+    state.protocol_major = p[1] >= '0' && p[1] <= '9' ? p[1] - '0' : 0;
+    return true;
+  }
+  if (c == "GY")
+    return true;  // Version string, not part of the state
+  if (c == "G9" && p.size() >= 2) {
+    // Half degrees with a +64C offset
+    state.temp_inside = (int16_t) (((uint8_t) p[0] / 2 - 64) * 10);
+    state.temp_outside = (int16_t) (((uint8_t) p[1] / 2 - 64) * 10);
+    return true;
+  }
+  if ((c == "SH" || c == "SI" || c == "Sa") && p.size() >= 4) {
+    int16_t temp = s21_reference_number(p, true);
+    if (c == "SH")
+      state.temp_inside = temp;
+    else if (c == "SI")
+      state.temp_coil = temp;
+    else
+      state.temp_outside = temp;
+    return true;
+  }
+  if (c == "SL" && p.size() >= 3) {
+    state.fan_rpm = (uint16_t) (s21_reference_number(p, true) * 10);
+    return true;
+  }
+  if (c == "Sd" && p.size() >= 3) {
+    state.idle = p.compare(0, 3, "000") == 0;
+    return true;
+  }
+  return false;
+}
+
+// D1 payload: power, mode, setpoint as 28 + half degrees C, fan.
+inline void s21_reference_d1(bool power_on, uint8_t mode, float setpoint,
+                             uint8_t fan, uint8_t *out) {
+  out[0] = power_on ? '1' : '0';
+  out[1] = mode;
+  out[2] = (uint8_t) (28 + lroundf(setpoint * 2));
+  out[3] = fan;
+}
+
+// D5 payload: swing mode, swing on, two unused bytes.
+inline void s21_reference_d5(bool swing_v, bool swing_h, uint8_t *out) {
+  static const char MODES[] = {'0', '1', '2', '7'};
+  out[0] = MODES[(swing_v ? 1 : 0) | (swing_h ? 2 : 0)];
+  out[1] = swing_v || swing_h ? '?' : '0';
+  out[2] = '0';
+  out[3] = '0';
+}
+
+struct S21DifferentialStats {
+  uint32_t frames = 0;
+  uint32_t decodes = 0;
+  uint32_t commands = 0;
+  uint32_t mismatches = 0;
+};
+
+}  // namespace daikin_s21
+}  // namespace esphome
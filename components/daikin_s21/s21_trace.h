@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace esphome {
+namespace daikin_s21 {
+
+// Warning classes aggregated by the protocol layer. The first occurrence in
+// each summary interval is logged in full, the rest are only counted.
+enum class S21Warning : uint8_t {
+  UnexpectedAck,
+  UnexpectedByte,
+  FrameTimeout,
+  ChecksumMismatch,
+  FrameOverflow,
+  AckTimeout,
+  NoAck,
+  Nak,
+  LineNoise,
+  ShortResponse,
+  COUNT,
+};
+
+inline const char *s21_warning_to_string(S21Warning w) {
+  switch (w) {
+    case S21Warning::UnexpectedAck:
+      return "unexpected ACK";
+    case S21Warning::UnexpectedByte:
+      return "unexpected byte";
+    case S21Warning::FrameTimeout:
+      return "frame timeout";
+    case S21Warning::ChecksumMismatch:
+      return "checksum mismatch";
+    case S21Warning::FrameOverflow:
+      return "frame overflow";
+    case S21Warning::AckTimeout:
+      return "ACK timeout";
+    case S21Warning::NoAck:
+      return "no ACK";
+    case S21Warning::Nak:
+      return "NAK";
+    case S21Warning::LineNoise:
+      return "line noise";
+    case S21Warning::ShortResponse:
+      return "short response";
+    default:
+      return "UNKNOWN";
+  }
+}
+
+class S21WarningCounter {
+ public:
+  // Counts an occurrence; true if it is the first one this interval and
+  // should be logged in full.
+  bool note(S21Warning w) { return this->counts[(size_t) w]++ == 0; }
+  uint32_t count(S21Warning w) const { return this->counts[(size_t) w]; }
+  // Occurrences beyond the first, which were not logged.
+  uint32_t suppressed(S21Warning w) const {
+    uint32_t c = this->count(w);
+    return c > 1 ? c - 1 : 0;
+  }
+  bool any_suppressed() const {
+    for (size_t i = 0; i < (size_t) S21Warning::COUNT; i++) {
+      if (this->counts[i] > 1)
+        return true;
+    }
+    return false;
+  }
+  void reset() { memset(this->counts, 0, sizeof(this->counts)); }
+
+ protected:
+  uint32_t counts[(size_t) S21Warning::COUNT] = {};
+};
+
+enum class S21TraceEvent : uint8_t {
+  TxFrame,
+  RxFrame,
+  Ack,
+  Nak,
+  UnexpectedByte,
+  UnexpectedAck,
+  Timeout,
+  ChecksumError,
+};
+
+inline const char *s21_trace_event_to_string(S21TraceEvent e) {
+  switch (e) {
+    case S21TraceEvent::TxFrame:
+      return "TX";
+    case S21TraceEvent::RxFrame:
+      return "RX";
+    case S21TraceEvent::Ack:
+      return "ACK";
+    case S21TraceEvent::Nak:
+      return "NAK";
+    case S21TraceEvent::UnexpectedByte:
+      return "JUNK";
+    case S21TraceEvent::UnexpectedAck:
+      return "XACK";
+    case S21TraceEvent::Timeout:
+      return "TIMEOUT";
+    case S21TraceEvent::ChecksumError:
+      return "CSUM";
+    default:
+      return "?";
+  }
+}
+
+static const size_t S21_TRACE_DATA_SIZE = 8;
+static const size_t S21_TRACE_SIZE = 64;
+
+struct S21TraceEntry {
+  uint32_t ms;
+  S21TraceEvent event;
+  uint8_t len;  // Original length, may exceed S21_TRACE_DATA_SIZE
+  uint8_t data[S21_TRACE_DATA_SIZE];
+};
+
+// Fixed-size ring of recent protocol events, keeping full detail around
+// even when the matching log lines are suppressed.
+class S21TraceBuffer {
+ public:
+  void add(uint32_t ms, S21TraceEvent event, const uint8_t *data = nullptr,
+           size_t len = 0) {
+    S21TraceEntry &e = this->entries[this->head];
+    e.ms = ms;
+    e.event = event;
+    e.len = len > 0xFF ? 0xFF : len;
+    if (len > 0)
+      memcpy(e.data, data,
+             len < S21_TRACE_DATA_SIZE ? len : S21_TRACE_DATA_SIZE);
+    this->head = (this->head + 1) % S21_TRACE_SIZE;
+    if (this->used < S21_TRACE_SIZE)
+      this->used++;
+  }
+  size_t size() const { return this->used; }
+  // Oldest entry is at index 0.
+  const S21TraceEntry &at(size_t i) const {
+    return this->entries[(this->head + S21_TRACE_SIZE - this->used + i) %
+                         S21_TRACE_SIZE];
+  }
+  void clear() { this->used = 0; }
+
+ protected:
+  S21TraceEntry entries[S21_TRACE_SIZE];
+  size_t head = 0;
+  size_t used = 0;
+};
+
+}  // namespace daikin_s21
+}  // namespace esphome
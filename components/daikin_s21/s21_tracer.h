@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+// Timing hook points in the transaction engine. The engine calls its
+// tracer at each point; with the default S21NullTracer the calls sit behind
+// `if constexpr` and compile to nothing. Building with -DS21_TRACING swaps
+// in S21ChromeTracer, which keeps a ring of timestamped points that can be
+// written out as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+//
+// No ESPHome dependencies, so the same tracer works in host builds.
+
+namespace esphome {
+namespace daikin_s21 {
+
+enum class S21TracePoint : uint8_t {
+  TxStart,  // Transaction taken off the queue, frame about to be written
+  TxEnd,    // Frame handed to the UART
+  Ack,      // ACK (or NAK) received
+  RxStart,  // STX of the response frame
+  Etx,      // ETX of the response frame
+  Decode,   // Response parsed into state
+  Done,     // Transaction finished, callback about to run
+  Publish,  // New state handed to entities
+};
+
+inline const char *s21_trace_point_to_string(S21TracePoint p) {
+  switch (p) {
+    case S21TracePoint::TxStart:
+      return "tx_start";
+    case S21TracePoint::TxEnd:
+      return "tx_end";
+    case S21TracePoint::Ack:
+      return "ack";
+    case S21TracePoint::RxStart:
+      return "rx_start";
+    case S21TracePoint::Etx:
+      return "etx";
+    case S21TracePoint::Decode:
+      return "decode";
+    case S21TracePoint::Done:
+      return "done";
+    case S21TracePoint::Publish:
+      return "publish";
+    default:
+      return "?";
+  }
+}
+
+struct S21NullTracer {
+  static constexpr bool enabled = false;
+  void point(S21TracePoint, uint32_t, const uint8_t *, size_t) {}
+};
+
+// Sink for write_json() that collects into a std::string, for host tools.
+struct S21StringStream {
+  std::string str;
+  void print(const char *s) { this->str += s; }
+};
+
+template<size_t N> class S21ChromeTracer {
+ public:
+  static constexpr bool enabled = true;
+
+  void point(S21TracePoint p, uint32_t us, const uint8_t *code,
+             size_t code_len) {
+    Entry &e = this->entries[this->head];
+    e.us = us;
+    e.point = p;
+    e.code[0] = code_len > 0 ? code[0] : '?';
+    e.code[1] = code_len > 1 ? code[1] : '\0';
+    e.code[2] = '\0';
+    this->head = (this->head + 1) % N;
+    if (this->used < N)
+      this->used++;
+  }
+
+  size_t size() const { return this->used; }
+  void clear() { this->used = 0; }
+
+  // Each transaction becomes a duration slice named after its request code,
+  // with the intermediate points as instant events inside it. Publish
+  // points go on their own track. Stream needs print(const char *).
+  template<typename Stream> void write_json(Stream *out) const {
+    char buf[96];
+    out->print("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool first = true;
+    bool open = false;
+    for (size_t i = 0; i < this->used; i++) {
+      const Entry &e = this->entries[(this->head + N - this->used + i) % N];
+      const char *phase = "i";
+      const char *name = s21_trace_point_to_string(e.point);
+      int tid = 1;
+      if (e.point == S21TracePoint::TxStart) {
+        phase = "B";
+        name = e.code;
+        open = true;
+      } else if (e.point == S21TracePoint::Done) {
+        // The ring may have dropped the matching begin.
+        if (!open)
+          continue;
+        phase = "E";
+        name = e.code;
+        open = false;
+      } else if (e.point == S21TracePoint::Publish) {
+        tid = 2;
+      }
+      snprintf(buf, sizeof(buf),
+               "%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%" PRIu32
+               ",\"pid\":1,\"tid\":%d%s}",
+               first ? "" : ",", name, phase, e.us, tid,
+               phase[0] == 'i' ? ",\"s\":\"t\"" : "");
+      out->print(buf);
+      first = false;
+    }
+    out->print("]}");
+  }
+
+ protected:
+  struct Entry {
+    uint32_t us;
+    S21TracePoint point;
+    char code[3];
+  };
+
+  Entry entries[N];
+  size_t head = 0;
+  size_t used = 0;
+};
+
+#ifdef S21_TRACING
+#ifndef S21_TRACING_SIZE
+#define S21_TRACING_SIZE 256
+#endif
+using S21Tracer = S21ChromeTracer<S21_TRACING_SIZE>;
+#else
+using S21Tracer = S21NullTracer;
+#endif
+
+}  // namespace daikin_s21
+}  // namespace esphome
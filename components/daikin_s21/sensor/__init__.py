@@ -9,9 +9,12 @@ from esphome.const import (
     CONF_ID,
     UNIT_CELSIUS,
     ICON_THERMOMETER,
+    DEVICE_CLASS_DURATION,
     DEVICE_CLASS_SPEED,
     DEVICE_CLASS_TEMPERATURE,
+    ENTITY_CATEGORY_DIAGNOSTIC,
     STATE_CLASS_MEASUREMENT,
+    UNIT_MILLISECOND,
 )
 
 from .. import (
@@ -30,6 +33,7 @@ CONF_INSIDE_TEMP = "inside_temperature"
 CONF_OUTSIDE_TEMP = "outside_temperature"
 CONF_COIL_TEMP = "coil_temperature"
 CONF_FAN_SPEED = "fan_speed"
+CONF_COMMAND_LATENCY = "command_latency"
 
 CONFIG_SCHEMA = (
     cv.COMPONENT_SCHEMA.extend(
@@ -63,6 +67,14 @@ CONFIG_SCHEMA = (
                 device_class=DEVICE_CLASS_SPEED,
                 state_class=STATE_CLASS_MEASUREMENT,
             ),
+            cv.Optional(CONF_COMMAND_LATENCY): sensor.sensor_schema(
+                unit_of_measurement=UNIT_MILLISECOND,
+                icon="mdi:timer-outline",
+                accuracy_decimals=0,
+                device_class=DEVICE_CLASS_DURATION,
+                state_class=STATE_CLASS_MEASUREMENT,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            ),
         }
     )
     .extend(S21_CLIENT_SCHEMA)
@@ -93,3 +105,7 @@ async def to_code(config):
     if CONF_FAN_SPEED in config:
         sens = await sensor.new_sensor(config[CONF_FAN_SPEED])
         cg.add(var.set_fan_speed_sensor(sens))
+
+    if CONF_COMMAND_LATENCY in config:
+        sens = await sensor.new_sensor(config[CONF_COMMAND_LATENCY])
+        cg.add(var.set_command_latency_sensor(sens))
@@ -5,6 +5,21 @@ namespace daikin_s21 {
 
 static const char *const TAG = "daikin_s21.sensor";
 
+void DaikinS21Sensor::setup() {
+  this->align_updates(this);
+  if (this->command_latency_sensor_ != nullptr) {
+    // Published per command rather than polled, so no sample is lost.
+    this->s21->add_on_command_callback([this]() {
+      if (this->s21->last_command_confirmed()) {
+        const DaikinS21Stats &stats = this->s21->get_stats();
+        this->command_latency_sensor_->publish_state(
+            stats.commands[(size_t) this->s21->last_command()]
+                .last_latency_ms);
+      }
+    });
+  }
+}
+
 void DaikinS21Sensor::update() {
   if (!this->s21->is_ready())
     return;
@@ -28,6 +43,7 @@ void DaikinS21Sensor::dump_config() {
   LOG_SENSOR("  ", "Temperature Outside", this->temp_outside_sensor_);
   LOG_SENSOR("  ", "Temperature Coil", this->temp_coil_sensor_);
   LOG_SENSOR("  ", "Fan Speed", this->fan_speed_sensor_);
+  LOG_SENSOR("  ", "Command Latency", this->command_latency_sensor_);
 }
 
 }  // namespace daikin_s21
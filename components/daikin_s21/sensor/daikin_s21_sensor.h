@@ -8,6 +8,7 @@ namespace daikin_s21 {
 
 class DaikinS21Sensor : public PollingComponent, public DaikinS21Client {
  public:
+  void setup() override;
   void update() override;
   void dump_config() override;
 
@@ -23,12 +24,16 @@ class DaikinS21Sensor : public PollingComponent, public DaikinS21Client {
   void set_fan_speed_sensor(sensor::Sensor *sensor) {
     this->fan_speed_sensor_ = sensor;
   }
+  void set_command_latency_sensor(sensor::Sensor *sensor) {
+    this->command_latency_sensor_ = sensor;
+  }
 
  protected:
   sensor::Sensor *temp_inside_sensor_{nullptr};
   sensor::Sensor *temp_outside_sensor_{nullptr};
   sensor::Sensor *temp_coil_sensor_{nullptr};
   sensor::Sensor *fan_speed_sensor_{nullptr};
+  sensor::Sensor *command_latency_sensor_{nullptr};
 };
 
 }  // namespace daikin_s21
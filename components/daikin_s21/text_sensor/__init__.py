@@ -0,0 +1,47 @@
+"""
+Text sensor component for daikin_s21.
+"""
+
+import esphome.codegen as cg
+import esphome.config_validation as cv
+from esphome.components import text_sensor
+from esphome.const import (
+    CONF_ID,
+    ENTITY_CATEGORY_DIAGNOSTIC,
+)
+
+from .. import (
+    daikin_s21_ns,
+    CONF_S21_ID,
+    S21_CLIENT_SCHEMA,
+    DaikinS21Client,
+)
+
+DaikinS21TextSensor = daikin_s21_ns.class_(
+    "DaikinS21TextSensor", cg.Component, DaikinS21Client
+)
+
+CONF_BENCHMARK = "benchmark"
+
+CONFIG_SCHEMA = cv.COMPONENT_SCHEMA.extend(
+    {
+        cv.GenerateID(): cv.declare_id(DaikinS21TextSensor),
+        cv.Optional(CONF_BENCHMARK): text_sensor.text_sensor_schema(
+            icon="mdi:speedometer",
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+    }
+).extend(S21_CLIENT_SCHEMA)
+
+
+async def to_code(config):
+    """Generate main.cpp code"""
+
+    var = cg.new_Pvariable(config[CONF_ID])
+    await cg.register_component(var, config)
+    s21_var = await cg.get_variable(config[CONF_S21_ID])
+    cg.add(var.set_s21(s21_var))
+
+    if CONF_BENCHMARK in config:
+        sens = await text_sensor.new_text_sensor(config[CONF_BENCHMARK])
+        cg.add(var.set_benchmark_text_sensor(sens))
@@ -0,0 +1,22 @@
+#include "daikin_s21_text_sensor.h"
+
+namespace esphome {
+namespace daikin_s21 {
+
+static const char *const TAG = "daikin_s21.text_sensor";
+
+void DaikinS21TextSensor::setup() {
+  if (this->benchmark_text_sensor_ != nullptr) {
+    this->s21->add_on_benchmark_callback([this](const std::string &summary) {
+      this->benchmark_text_sensor_->publish_state(summary);
+    });
+  }
+}
+
+void DaikinS21TextSensor::dump_config() {
+  ESP_LOGCONFIG(TAG, "Daikin S21 Text Sensor:");
+  LOG_TEXT_SENSOR("  ", "Benchmark", this->benchmark_text_sensor_);
+}
+
+}  // namespace daikin_s21
+}  // namespace esphome
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "esphome/components/text_sensor/text_sensor.h"
+#include "../s21.h"
+
+namespace esphome {
+namespace daikin_s21 {
+
+class DaikinS21TextSensor : public Component, public DaikinS21Client {
+ public:
+  void setup() override;
+  void dump_config() override;
+
+  void set_benchmark_text_sensor(text_sensor::TextSensor *sensor) {
+    this->benchmark_text_sensor_ = sensor;
+  }
+
+ protected:
+  text_sensor::TextSensor *benchmark_text_sensor_{nullptr};
+};
+
+}  // namespace daikin_s21
+}  // namespace esphome
@@ -0,0 +1,7 @@
+"""
+Header-only S21 protocol core shared by daikin_s21 and s21_sim.
+"""
+
+import esphome.config_validation as cv
+
+CONFIG_SCHEMA = cv.Schema({})
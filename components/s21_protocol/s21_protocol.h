@@ -0,0 +1,241 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// S21 framing, checksum and value codecs shared by the daikin_s21 master and
+// the s21_sim unit. Kept free of ESPHome dependencies so it can be built and
+// exercised on a host as well.
+
+namespace esphome {
+namespace s21_protocol {
+
+static const uint8_t STX = 2;
+static const uint8_t ETX = 3;
+static const uint8_t ACK = 6;
+static const uint8_t NAK = 21;
+
+static const uint32_t S21_RESPONSE_TIMEOUT = 250;  // ms
+// Longest payload seen in the wild is well under this; anything longer is
+// line noise.
+static const size_t S21_MAX_FRAME_SIZE = 32;
+// STX + payload + checksum + ETX
+static const size_t S21_MAX_ENCODED_SIZE = S21_MAX_FRAME_SIZE + 3;
+
+inline uint8_t s21_checksum(const uint8_t *bytes, size_t len) {
+  uint8_t checksum = 0;
+  for (size_t i = 0; i < len; i++) {
+    checksum += bytes[i];
+  }
+  return checksum;
+}
+
+inline uint8_t s21_checksum(const std::vector<uint8_t> &bytes) {
+  return s21_checksum(bytes.data(), bytes.size());
+}
+
+// Writes STX, payload, checksum, ETX into out, which must have room for
+// len + 3 bytes. Returns the encoded length.
+inline size_t encode_frame(const uint8_t *payload, size_t len, uint8_t *out) {
+  out[0] = STX;
+  for (size_t i = 0; i < len; i++) {
+    out[i + 1] = payload[i];
+  }
+  out[len + 1] = s21_checksum(payload, len);
+  out[len + 2] = ETX;
+  return len + 3;
+}
+
+enum class FrameResult : uint8_t {
+  Pending,         // Need more bytes
+  Frame,           // Complete frame with valid checksum
+  ChecksumError,   // Complete frame, checksum mismatch
+  Overflow,        // Frame exceeded S21_MAX_FRAME_SIZE, discarded
+  UnexpectedAck,   // ACK while waiting for STX
+  UnexpectedByte,  // Other byte while waiting for STX
+};
+
+// Byte-at-a-time frame assembler with a fixed buffer. Never blocks and never
+// allocates, so it can run from loop() and on arbitrary input.
+class FrameAssembler {
+ public:
+  FrameResult feed(uint8_t byte) {
+    if (!this->reading) {
+      if (byte == STX) {
+        this->start();
+        return FrameResult::Pending;
+      }
+      return byte == ACK ? FrameResult::UnexpectedAck
+                         : FrameResult::UnexpectedByte;
+    }
+    if (byte == STX) {
+      // Restart; the previous frame was truncated.
+      this->start();
+      return FrameResult::Pending;
+    }
+    if (byte == ETX) {
+      this->reading = false;
+      if (this->len == 0) {
+        // STX ETX: no checksum at all. size() is 0, which callers must not
+        // take for a frame even if the checksums happen to agree.
+        return FrameResult::ChecksumError;
+      }
+      this->len--;
+      this->rx_csum = this->buf[this->len];
+      this->calc_csum = s21_checksum(this->buf, this->len);
+      return this->rx_csum == this->calc_csum ? FrameResult::Frame
+                                              : FrameResult::ChecksumError;
+    }
+    if (this->len == sizeof(this->buf)) {
+      this->reading = false;
+      this->len = 0;
+      return FrameResult::Overflow;
+    }
+    this->buf[this->len++] = byte;
+    return FrameResult::Pending;
+  }
+
+  void reset() {
+    this->reading = false;
+    this->len = 0;
+  }
+  bool is_reading() const { return this->reading; }
+  // Payload of the last completed frame, checksum excluded.
+  const uint8_t *data() const { return this->buf; }
+  size_t size() const { return this->len; }
+  uint8_t received_checksum() const { return this->rx_csum; }
+  uint8_t computed_checksum() const { return this->calc_csum; }
+
+ protected:
+  void start() {
+    this->reading = true;
+    this->len = 0;
+    this->rx_csum = 0;
+    this->calc_csum = 0;
+  }
+
+  uint8_t buf[S21_MAX_FRAME_SIZE + 1];  // Payload plus checksum
+  size_t len = 0;
+  bool reading = false;
+  uint8_t rx_csum = 0;
+  uint8_t calc_csum = 0;
+};
+
+// Value codecs
+
+// <ones><tens><hundreds><neg/pos>
+inline int16_t bytes_to_num(const uint8_t *bytes, size_t len) {
+  int16_t val = 0;
+  val = bytes[0] - '0';
+  val += (bytes[1] - '0') * 10;
+  val += (bytes[2] - '0') * 100;
+  if (len > 3 && bytes[3] == '-')
+    val *= -1;
+  return val;
+}
+
+inline int16_t temp_bytes_to_c10(const uint8_t *bytes) {
+  return bytes_to_num(bytes, 4);
+}
+
+inline int16_t temp_f9_byte_to_c10(const uint8_t *bytes) {
+  return (*bytes / 2 - 64) * 10;
+}
+
+inline uint8_t c10_to_setpoint_byte(int16_t setpoint) {
+  return (setpoint + 3) / 5 + 28;
+}
+
+inline int16_t setpoint_byte_to_c10(uint8_t byte) { return (byte - 28) * 5; }
+
+// Payload bytes (after the two byte response code) the decoders read for a
+// response; 0 if the response is not decoded field by field.
+inline size_t s21_payload_size(uint8_t r0, uint8_t r1) {
+  if (r0 == 'G') {
+    switch (r1) {
+      case '1':
+        return 4;  // power, mode, setpoint, fan
+      case '5':
+        return 1;  // swing
+      case '8':
+        return 2;  // protocol version
+      case '9':
+        return 2;  // inside, outside
+    }
+  } else if (r0 == 'S') {
+    switch (r1) {
+      case 'H':
+      case 'I':
+      case 'a':
+        return 4;  // temperature with sign
+      case 'L':
+      case 'd':
+        return 3;
+    }
+  }
+  return 0;
+}
+
+// Debug representations, adapted from ESPHome UART debugger
+
+inline std::string hex_repr(const uint8_t *bytes, size_t len) {
+  std::string res;
+  char buf[5];
+  for (size_t i = 0; i < len; i++) {
+    if (i > 0)
+      res += ':';
+    snprintf(buf, sizeof(buf), "%02X", bytes[i]);
+    res += buf;
+  }
+  return res;
+}
+
+inline std::string hex_repr(const std::vector<uint8_t> &bytes) {
+  return hex_repr(bytes.data(), bytes.size());
+}
+
+inline std::string str_repr(const uint8_t *bytes, size_t len) {
+  std::string res;
+  char buf[5];
+  for (size_t i = 0; i < len; i++) {
+    if (bytes[i] == 7) {
+      res += "\\a";
+    } else if (bytes[i] == 8) {
+      res += "\\b";
+    } else if (bytes[i] == 9) {
+      res += "\\t";
+    } else if (bytes[i] == 10) {
+      res += "\\n";
+    } else if (bytes[i] == 11) {
+      res += "\\v";
+    } else if (bytes[i] == 12) {
+      res += "\\f";
+    } else if (bytes[i] == 13) {
+      res += "\\r";
+    } else if (bytes[i] == 27) {
+      res += "\\e";
+    } else if (bytes[i] == 34) {
+      res += "\\\"";
+    } else if (bytes[i] == 39) {
+      res += "\\'";
+    } else if (bytes[i] == 92) {
+      res += "\\\\";
+    } else if (bytes[i] < 32 || bytes[i] > 127) {
+      snprintf(buf, sizeof(buf), "\\x%02X", bytes[i]);
+      res += buf;
+    } else {
+      res += bytes[i];
+    }
+  }
+  return res;
+}
+
+inline std::string str_repr(const std::vector<uint8_t> &bytes) {
+  return str_repr(bytes.data(), bytes.size());
+}
+
+}  // namespace s21_protocol
+}  // namespace esphome
@@ -2,24 +2,124 @@
 Pretend to be a Daikin mini split.
 """
 
+from esphome import automation
 import esphome.codegen as cg
 import esphome.config_validation as cv
 from esphome.components import uart
-from esphome.const import CONF_ID
+from esphome.const import (
+    CONF_DURATION,
+    CONF_FAN_MODE,
+    CONF_ID,
+    CONF_MODE,
+    SCHEDULER_DONT_RUN,
+)
 
 DEPENDENCIES = ["uart"]
+AUTO_LOAD = ["s21_protocol"]
+# One entry per simulated unit, each on its own UART.
+MULTI_CONF = True
 
 CONF_TX_UART = "tx_uart"
 CONF_RX_UART = "rx_uart"
+CONF_FAULT = "fault"
+CONF_SCENARIO = "scenario"
+CONF_AT = "at"
+CONF_SETPOINT = "setpoint"
+CONF_POWER = "power"
+CONF_EXPECT_WITHIN = "expect_within"
+CONF_DEFROST = "defrost"
+CONF_DISCONNECT = "disconnect"
+CONF_REBOOT = "reboot"
+CONF_TIMING_REPORT_INTERVAL = "timing_report_interval"
+CONF_PROFILE = "profile"
+CONF_QUERY = "query"
+CONF_RESPONSE = "response"
+CONF_NAK_RATE = "nak_rate"
+CONF_LATENCY = "latency"
+CONF_CHECKSUM_OFFSET = "checksum_offset"
+CONF_ECHO_UNUSED_FIELDS = "echo_unused_fields"
 
 s21_sim_ns = cg.esphome_ns.namespace("s21_sim")
 S21SIM = s21_sim_ns.class_("S21SIM", cg.Component, uart.UARTDevice)
 uart_ns = cg.esphome_ns.namespace("uart")
 UARTComponent = uart_ns.class_("UARTComponent")
+S21Fault = s21_sim_ns.enum("S21Fault", is_class=True)
+S21ScenarioAction = s21_sim_ns.enum("S21ScenarioAction", is_class=True)
+StartScenarioAction = s21_sim_ns.class_("StartScenarioAction", automation.Action)
+InjectFaultAction = s21_sim_ns.class_("InjectFaultAction", automation.Action)
+
+FAULTS = {
+    "lost_ack": S21Fault.LostAck,
+    "bad_checksum": S21Fault.BadChecksum,
+    "disconnect": S21Fault.Disconnect,
+    "garbage_burst": S21Fault.GarbageBurst,
+}
+
+# F1 characters
+MODES = {"auto": "1", "dry": "2", "cool": "3", "heat": "4", "fan_only": "6"}
+FAN_MODES = {
+    "auto": "A",
+    "silent": "B",
+    "1": "3",
+    "2": "4",
+    "3": "5",
+    "4": "6",
+    "5": "7",
+}
+
+# What the unit does at each step; exactly one per step.
+STEP_ACTIONS = {
+    CONF_SETPOINT: cv.temperature,
+    CONF_POWER: cv.boolean,
+    CONF_MODE: cv.one_of(*MODES, lower=True),
+    CONF_FAN_MODE: cv.one_of(*FAN_MODES, lower=True),
+    CONF_DEFROST: cv.positive_time_period_milliseconds,
+    CONF_DISCONNECT: cv.positive_time_period_milliseconds,
+    CONF_REBOOT: cv.positive_time_period_milliseconds,
+}
+
+SCENARIO_STEP_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.Required(CONF_AT): cv.positive_time_period_milliseconds,
+            cv.Optional(CONF_EXPECT_WITHIN): cv.positive_time_period_milliseconds,
+            **{cv.Optional(key): validator for key, validator in STEP_ACTIONS.items()},
+        }
+    ),
+    cv.has_exactly_one_key(*STEP_ACTIONS),
+)
+
+
+def hex_bytes(value):
+    """Bytes as written in the protocol logs, e.g. "53:48:30:33:32:2B"."""
+    value = cv.string_strict(value).replace(":", "").replace(" ", "")
+    try:
+        return list(bytes.fromhex(value))
+    except ValueError as err:
+        raise cv.Invalid(f"Invalid hex bytes: {err}") from err
+
+
+PROFILE_QUERY_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_QUERY): cv.All(cv.string_strict, cv.Length(min=1, max=4)),
+        cv.Optional(CONF_RESPONSE, default=""): hex_bytes,
+        cv.Optional(CONF_NAK_RATE, default="0%"): cv.percentage,
+        cv.Optional(
+            CONF_LATENCY, default="0ms"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_CHECKSUM_OFFSET, default=0): cv.uint8_t,
+    }
+)
 
 CONFIG_SCHEMA = (cv.Schema(
         {
             cv.GenerateID(): cv.declare_id(S21SIM),
+            cv.Optional(CONF_SCENARIO): cv.ensure_list(SCENARIO_STEP_SCHEMA),
+            cv.Optional(CONF_PROFILE): cv.ensure_list(PROFILE_QUERY_SCHEMA),
+            cv.Optional(
+                CONF_TIMING_REPORT_INTERVAL, default="60s"
+            ): cv.update_interval,
+            cv.Optional(CONF_ECHO_UNUSED_FIELDS, default=True): cv.boolean,
             # cv.Required(CONF_TX_UART): cv.use_id(UARTComponent),
             # cv.Required(CONF_RX_UART): cv.use_id(UARTComponent),
         }
@@ -36,3 +136,87 @@ async def to_code(config):
     # rx_uart = await cg.get_variable(config[CONF_RX_UART])
     # cg.add(sim.set_uarts(tx_uart, rx_uart))
     await uart.register_uart_device(sim, config)
+    cg.add(sim.set_name(str(config[CONF_ID])))
+    interval = config[CONF_TIMING_REPORT_INTERVAL]
+    # "never" validates to SCHEDULER_DONT_RUN rather than a TimePeriod.
+    if interval == SCHEDULER_DONT_RUN:
+        interval = 0
+    else:
+        interval = interval.total_milliseconds
+    cg.add(sim.set_timing_report_interval(interval))
+    cg.add(sim.set_echo_unused_fields(config[CONF_ECHO_UNUSED_FIELDS]))
+    for query in config.get(CONF_PROFILE, []):
+        cg.add(
+            sim.add_profile_query(
+                query[CONF_QUERY],
+                query[CONF_RESPONSE],
+                query[CONF_NAK_RATE],
+                query[CONF_LATENCY].total_milliseconds,
+                query[CONF_CHECKSUM_OFFSET],
+            )
+        )
+    for step in config.get(CONF_SCENARIO, []):
+        at = step[CONF_AT].total_milliseconds
+        expect = step.get(CONF_EXPECT_WITHIN)
+        expect = expect.total_milliseconds if expect is not None else 0
+        if CONF_SETPOINT in step:
+            action = S21ScenarioAction.Setpoint
+            value = round(step[CONF_SETPOINT] * 10)
+        elif CONF_POWER in step:
+            action = S21ScenarioAction.Power
+            value = int(step[CONF_POWER])
+        elif CONF_MODE in step:
+            action = S21ScenarioAction.Mode
+            value = ord(MODES[step[CONF_MODE]])
+        elif CONF_FAN_MODE in step:
+            action = S21ScenarioAction.Fan
+            value = ord(FAN_MODES[step[CONF_FAN_MODE]])
+        elif CONF_DEFROST in step:
+            action = S21ScenarioAction.Defrost
+            value = step[CONF_DEFROST].total_milliseconds
+        elif CONF_DISCONNECT in step:
+            action = S21ScenarioAction.Disconnect
+            value = step[CONF_DISCONNECT].total_milliseconds
+        else:
+            action = S21ScenarioAction.Reboot
+            value = step[CONF_REBOOT].total_milliseconds
+        cg.add(sim.add_scenario_step(action, value, at, expect))
+
+
+@automation.register_action(
+    "s21_sim.inject_fault",
+    InjectFaultAction,
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.use_id(S21SIM),
+            cv.Required(CONF_FAULT): cv.enum(FAULTS, lower=True),
+            cv.Optional(CONF_DURATION, default="10s"): cv.templatable(
+                cv.positive_time_period_milliseconds
+            ),
+        }
+    ),
+)
+async def inject_fault_to_code(config, action_id, template_arg, args):
+    """Generate code for the inject_fault action"""
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    cg.add(var.set_fault(config[CONF_FAULT]))
+    duration = await cg.templatable(config[CONF_DURATION], args, cg.uint32)
+    cg.add(var.set_duration(duration))
+    return var
+
+
+@automation.register_action(
+    "s21_sim.start_scenario",
+    StartScenarioAction,
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.use_id(S21SIM),
+        }
+    ),
+)
+async def start_scenario_to_code(config, action_id, template_arg, args):
+    """Generate code for the start_scenario action"""
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    return var
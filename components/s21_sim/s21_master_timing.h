@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <map>
+#include <string>
+#include "esphome/components/s21_protocol/s21_protocol.h"
+
+// Measures the master from the unit's side of the wire. Fed every received
+// byte and every reply with a microsecond timestamp, it keeps histograms of
+// the master's ACK turnaround and inter-frame gaps, counts queries, retries
+// and protocol violations. Plain data, no ESPHome dependencies, so it can
+// be driven with virtual time on a host too.
+
+namespace esphome {
+namespace s21_sim {
+
+// Upper bucket bounds in microseconds; the last bucket is open ended.
+static const uint32_t S21_TIMING_BUCKETS_US[] = {
+    500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000};
+static const size_t S21_TIMING_BUCKET_COUNT =
+    sizeof(S21_TIMING_BUCKETS_US) / sizeof(S21_TIMING_BUCKETS_US[0]);
+
+struct S21TimingHistogram {
+  uint32_t buckets[S21_TIMING_BUCKET_COUNT + 1] = {};
+  uint32_t count = 0;
+  uint32_t min_us = UINT32_MAX;
+  uint32_t max_us = 0;
+  uint64_t sum_us = 0;
+
+  void add(uint32_t us) {
+    size_t bucket = 0;
+    while (bucket < S21_TIMING_BUCKET_COUNT &&
+           us > S21_TIMING_BUCKETS_US[bucket]) {
+      bucket++;
+    }
+    this->buckets[bucket]++;
+    this->count++;
+    this->sum_us += us;
+    if (us < this->min_us)
+      this->min_us = us;
+    if (us > this->max_us)
+      this->max_us = us;
+  }
+
+  // "n=12 min=0.41 avg=0.88 max=2.10ms | <=0.5:3 <=1:7 <=2:1 <=5:1",
+  // empty buckets left out.
+  std::string to_string() const {
+    if (this->count == 0)
+      return "n=0";
+    char buf[96];
+    snprintf(buf, sizeof(buf), "n=%" PRIu32 " min=%.2f avg=%.2f max=%.2fms |",
+             this->count, this->min_us / 1000.0f,
+             (float) (this->sum_us / this->count) / 1000.0f,
+             this->max_us / 1000.0f);
+    std::string res = buf;
+    for (size_t i = 0; i <= S21_TIMING_BUCKET_COUNT; i++) {
+      if (this->buckets[i] == 0)
+        continue;
+      if (i < S21_TIMING_BUCKET_COUNT) {
+        snprintf(buf, sizeof(buf), " <=%g:%" PRIu32,
+                 S21_TIMING_BUCKETS_US[i] / 1000.0f, this->buckets[i]);
+      } else {
+        snprintf(buf, sizeof(buf), " >%g:%" PRIu32,
+                 S21_TIMING_BUCKETS_US[i - 1] / 1000.0f, this->buckets[i]);
+      }
+      res += buf;
+    }
+    return res;
+  }
+};
+
+enum class S21Violation : uint8_t {
+  MissingAck,     // Response frame not acknowledged
+  UnexpectedAck,  // ACK with no response frame outstanding
+  Overlap,        // New frame started before the last one was answered
+  Truncated,      // STX inside a frame
+  BadChecksum,    // Request frame with a wrong checksum
+  StrayByte,      // Anything else between frames
+  COUNT,
+};
+
+inline const char *s21_violation_to_string(S21Violation violation) {
+  switch (violation) {
+    case S21Violation::MissingAck:
+      return "missing_ack";
+    case S21Violation::UnexpectedAck:
+      return "unexpected_ack";
+    case S21Violation::Overlap:
+      return "overlap";
+    case S21Violation::Truncated:
+      return "truncated";
+    case S21Violation::BadChecksum:
+      return "bad_checksum";
+    case S21Violation::StrayByte:
+      return "stray_byte";
+    default:
+      return "UNKNOWN";
+  }
+}
+
+// What the unit sent back for the last request.
+enum class S21Reply : uint8_t {
+  Ack,           // ACK only (commands)
+  Nak,           // NAK only (unsupported request)
+  Frame,         // ACK and a response frame the master should acknowledge
+  CorruptFrame,  // ACK and a frame the master must not acknowledge
+  None,          // Nothing (dropped or garbage); the master will time out
+};
+
+class S21MasterTiming {
+ public:
+  void on_rx(uint8_t byte, uint32_t now_us) {
+    using namespace s21_protocol;
+    if (this->awaiting_ack) {
+      this->awaiting_ack = false;
+      if (byte == ACK) {
+        // reply_us is when the UART should have finished sending, which
+        // can be a little off.
+        int32_t turnaround = now_us - this->reply_us;
+        this->ack.add(turnaround > 0 ? turnaround : 0);
+        this->exchange_end_us = now_us;
+        this->clean = true;
+        this->acked_frames++;
+        return;
+      }
+      this->violation(S21Violation::MissingAck);
+      this->exchange_end_us = this->reply_us;
+    }
+    if (byte == STX) {
+      if (this->in_frame) {
+        this->violation(S21Violation::Truncated);
+      } else if (this->pending_reply) {
+        this->violation(S21Violation::Overlap);
+      } else if (this->exchange_end_us != 0) {
+        int32_t gap = now_us - this->exchange_end_us;
+        this->gap.add(gap > 0 ? gap : 0);
+      }
+      this->in_frame = true;
+      this->len = 0;
+      return;
+    }
+    if (!this->in_frame) {
+      this->violation(byte == ACK ? S21Violation::UnexpectedAck
+                                  : S21Violation::StrayByte);
+      return;
+    }
+    if (byte == ETX) {
+      this->in_frame = false;
+      this->end_frame();
+      return;
+    }
+    if (this->len < sizeof(this->frame)) {
+      this->frame[this->len] = byte;
+    }
+    this->len++;
+  }
+
+  void on_reply(S21Reply reply, uint32_t now_us) {
+    this->pending_reply = false;
+    this->reply_us = now_us;
+    this->awaiting_ack = reply == S21Reply::Frame;
+    if (!this->awaiting_ack) {
+      this->exchange_end_us = now_us;
+      this->clean = reply == S21Reply::Ack;
+    }
+  }
+
+  // Catches a missing ACK when the master goes quiet afterwards.
+  void check(uint32_t now_us) {
+    if (this->awaiting_ack &&
+        (int32_t) (now_us - this->reply_us) >
+            (int32_t) s21_protocol::S21_RESPONSE_TIMEOUT * 1000) {
+      this->awaiting_ack = false;
+      this->violation(S21Violation::MissingAck);
+      this->exchange_end_us = this->reply_us;
+    }
+  }
+
+  // The link went down; whatever was in progress is lost, but the counts
+  // and histograms stay.
+  void link_lost() {
+    this->in_frame = false;
+    this->pending_reply = false;
+    this->awaiting_ack = false;
+    this->exchange_end_us = 0;
+  }
+
+  // Starts a new reporting window; an exchange in progress carries over.
+  void clear() {
+    this->ack = S21TimingHistogram();
+    this->gap = S21TimingHistogram();
+    this->queries.clear();
+    this->requests = 0;
+    this->retries = 0;
+    for (auto &count : this->violations)
+      count = 0;
+  }
+
+  S21TimingHistogram ack;  // Response frame sent -> master ACK
+  S21TimingHistogram gap;  // End of exchange -> next request STX
+  std::map<std::string, uint32_t> queries;
+  uint32_t requests = 0;
+  uint32_t retries = 0;
+  uint32_t violations[(size_t) S21Violation::COUNT] = {};
+  // Response frames the master acknowledged, since boot.
+  uint32_t acked_frames = 0;
+
+ protected:
+  void violation(S21Violation violation) {
+    this->violations[(size_t) violation]++;
+    this->clean = false;
+  }
+
+  void end_frame() {
+    // Payload plus checksum, as framed by the master.
+    if (this->len < 2 || this->len > sizeof(this->frame)) {
+      this->violation(S21Violation::BadChecksum);
+      return;
+    }
+    size_t payload_len = this->len - 1;
+    if (s21_protocol::s21_checksum(this->frame, payload_len) !=
+        this->frame[payload_len]) {
+      this->violation(S21Violation::BadChecksum);
+      return;
+    }
+    std::string request(this->frame, this->frame + payload_len);
+    // The same request again after an exchange that went wrong is the
+    // master retrying; a plan polling one query back to back is not.
+    if (!this->clean && request == this->last_request) {
+      this->retries++;
+    }
+    this->requests++;
+    this->queries[request.substr(0, 2)]++;
+    this->last_request = request;
+    this->pending_reply = true;
+  }
+
+  uint8_t frame[s21_protocol::S21_MAX_FRAME_SIZE + 1];
+  size_t len = 0;
+  bool in_frame = false;
+  bool pending_reply = false;
+  bool awaiting_ack = false;
+  bool clean = true;  // Whether the last exchange completed normally
+  uint32_t reply_us = 0;
+  uint32_t exchange_end_us = 0;
+  std::string last_request;
+};
+
+}  // namespace s21_sim
+}  // namespace esphome
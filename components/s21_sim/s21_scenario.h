@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Timed scenario steps for the simulator: things a real unit does on its
+// own (IR remote changes, defrost, cable drops, reboots). Each step can
+// carry a deadline for the master to observe it, checked against the
+// queries the master sends afterwards. Plain data, no ESPHome
+// dependencies, so scripts can be built and checked on a host too.
+
+namespace esphome {
+namespace s21_sim {
+
+enum class S21ScenarioAction : uint8_t {
+  Setpoint,    // value: setpoint in tenths of a degree C
+  Power,       // value: 0 or 1
+  Mode,        // value: mode character as sent in F1 ('1'..'6')
+  Fan,         // value: fan character as sent in F1
+  Defrost,     // value: duration in ms; fan stops and the coil warms up
+  Disconnect,  // value: duration in ms; nothing received or sent
+  Reboot,      // value: downtime in ms; state resets to power-on defaults
+};
+
+inline const char *s21_scenario_action_to_string(S21ScenarioAction action) {
+  switch (action) {
+    case S21ScenarioAction::Setpoint:
+      return "setpoint";
+    case S21ScenarioAction::Power:
+      return "power";
+    case S21ScenarioAction::Mode:
+      return "mode";
+    case S21ScenarioAction::Fan:
+      return "fan";
+    case S21ScenarioAction::Defrost:
+      return "defrost";
+    case S21ScenarioAction::Disconnect:
+      return "disconnect";
+    case S21ScenarioAction::Reboot:
+      return "reboot";
+    default:
+      return "UNKNOWN";
+  }
+}
+
+// The query whose answer shows the master has seen the step's effect.
+inline const char *s21_scenario_observed_by(S21ScenarioAction action) {
+  return action == S21ScenarioAction::Defrost ? "RL" : "F1";
+}
+
+// Whether observation can only start once the link is back.
+inline bool s21_scenario_is_outage(S21ScenarioAction action) {
+  return action == S21ScenarioAction::Disconnect ||
+         action == S21ScenarioAction::Reboot;
+}
+
+struct S21ScenarioStep {
+  uint32_t at_ms;      // From scenario start
+  S21ScenarioAction action;
+  int32_t value;
+  uint32_t expect_ms;  // Deadline for the master to observe it, 0 for none
+};
+
+}  // namespace s21_sim
+}  // namespace esphome
@@ -1,3 +1,4 @@
+#include <cinttypes>
 #include <map>
 #include "esphome/core/defines.h"
 #include "esphome/core/component.h"
@@ -6,175 +7,435 @@
 #include "s21_sim.h"
 
 using namespace esphome;
+using namespace esphome::s21_protocol;
 
 static const char *const TAG = "s21sim";
 
 namespace esphome {
 namespace s21_sim {
 
-#define STX 2
-#define ETX 3
-#define ACK 6
-#define NAK 21
+// void S21SIM::set_uarts(uart::UARTComponent *tx, uart::UARTComponent *rx) {
+//   this->uart = new UARTDevicePair();
+//   this->uart->set_uart_tx_parent(tx);
+//   this->uart->set_uart_rx_parent(rx);
+// }
+
+// Random bytes written for a garbage burst.
+#define S21_SIM_GARBAGE_BYTES 64
 
-#define S21_RESPONSE_TIMEOUT 250
+// Basic state after boot: on, cool, 23.5C, auto fan.
+static const uint8_t S21_SIM_DEFAULT_BASIC[4] = {'1', '3', 'K', 'A'};
 
-uint8_t s21_checksum(uint8_t *bytes, uint8_t len) {
-  uint8_t checksum = 0;
-  for (uint8_t i = 0; i < len; i++) {
-    checksum += bytes[i];
+const char *s21_fault_to_string(S21Fault fault) {
+  switch (fault) {
+    case S21Fault::LostAck:
+      return "lost ACK";
+    case S21Fault::BadChecksum:
+      return "bad checksum";
+    case S21Fault::Disconnect:
+      return "disconnect";
+    case S21Fault::GarbageBurst:
+      return "garbage burst";
+    default:
+      return "UNKNOWN";
   }
-  return checksum;
 }
 
-uint8_t s21_checksum(std::vector<uint8_t> bytes) {
-  return s21_checksum(&bytes[0], bytes.size());
+void S21SIM::setup() {
+  // Start bit, data bits, parity and stop bits per byte on the wire.
+  bool parity = this->parent_->get_parity() != uart::UART_CONFIG_PARITY_NONE;
+  uint32_t bits = 1 + this->parent_->get_data_bits() + parity +
+                  this->parent_->get_stop_bits();
+  this->byte_time_us = bits * 1000000 / this->parent_->get_baud_rate();
+  // Replies and timing need the loop to come round far more often than
+  // every 16ms.
+  this->high_freq.start();
+  this->timing_start = millis();
+  if (this->timing_report_interval > 0) {
+    this->set_interval("timing_report", this->timing_report_interval,
+                       [this]() { this->report_timing(); });
+  }
 }
 
-// void S21SIM::set_uarts(uart::UARTComponent *tx, uart::UARTComponent *rx) {
-//   this->uart = new UARTDevicePair();
-//   this->uart->set_uart_tx_parent(tx);
-//   this->uart->set_uart_rx_parent(rx);
-// }
+void S21SIM::dump_config() {
+  ESP_LOGCONFIG(TAG, "S21 Sim %s", this->name.c_str());
+  if (this->timing_report_interval > 0) {
+    ESP_LOGCONFIG(TAG, "  Timing report interval: %" PRIu32 "ms",
+                  this->timing_report_interval);
+  }
+}
+
+void S21SIM::report_timing() {
+  const S21MasterTiming &t = this->timing;
+  uint32_t elapsed = millis() - this->timing_start;
+  ESP_LOGI(TAG,
+           "%s: Master over %" PRIu32 "s: %" PRIu32
+           " requests (%.2f/s), %" PRIu32 " retries",
+           this->name.c_str(), elapsed / 1000, t.requests,
+           elapsed > 0 ? t.requests * 1000.0f / elapsed : 0.0f, t.retries);
+  ESP_LOGI(TAG, "%s:   ACK turnaround: %s", this->name.c_str(),
+           t.ack.to_string().c_str());
+  ESP_LOGI(TAG, "%s:   Frame gap: %s", this->name.c_str(),
+           t.gap.to_string().c_str());
+  std::string line;
+  char buf[48];
+  for (const auto &q : t.queries) {
+    snprintf(buf, sizeof(buf), " %s:%" PRIu32, q.first.c_str(), q.second);
+    line += buf;
+  }
+  ESP_LOGI(TAG, "%s:   Queries:%s", this->name.c_str(),
+           line.empty() ? " none" : line.c_str());
+  line.clear();
+  for (size_t i = 0; i < (size_t) S21Violation::COUNT; i++) {
+    if (t.violations[i] == 0)
+      continue;
+    snprintf(buf, sizeof(buf), " %s:%" PRIu32,
+             s21_violation_to_string((S21Violation) i), t.violations[i]);
+    line += buf;
+  }
+  ESP_LOGI(TAG, "%s:   Violations:%s", this->name.c_str(),
+           line.empty() ? " none" : line.c_str());
+  this->timing.clear();
+  this->timing_start = millis();
+}
+
+void S21SIM::inject_fault(S21Fault fault, uint32_t duration_ms) {
+  ESP_LOGI(TAG, "%s: Injecting fault: %s", this->name.c_str(),
+           s21_fault_to_string(fault));
+  switch (fault) {
+    case S21Fault::LostAck:
+      this->lost_ack_pending = true;
+      break;
+    case S21Fault::BadChecksum:
+      this->bad_checksum_pending = true;
+      break;
+    case S21Fault::Disconnect:
+      this->disconnected = true;
+      this->disconnect_start = millis();
+      this->disconnect_ms = duration_ms;
+      break;
+    case S21Fault::GarbageBurst:
+      this->garbage_pending = true;
+      break;
+  }
+}
 
-// Adapated from ESPHome UART debugger
-std::string hex_repr(uint8_t *bytes, size_t len) {
-  std::string res;
-  char buf[5];
-  for (size_t i = 0; i < len; i++) {
-    if (i > 0)
-      res += ':';
-    sprintf(buf, "%02X", bytes[i]);
-    res += buf;
-  }
-  return res;
-}
-
-std::string hex_repr(std::vector<uint8_t> &bytes) {
-  return hex_repr(&bytes[0], bytes.size());
-}
-
-// Adapated from ESPHome UART debugger
-std::string str_repr(uint8_t *bytes, size_t len) {
-  std::string res;
-  char buf[5];
-  for (size_t i = 0; i < len; i++) {
-    if (bytes[i] == 7) {
-      res += "\\a";
-    } else if (bytes[i] == 8) {
-      res += "\\b";
-    } else if (bytes[i] == 9) {
-      res += "\\t";
-    } else if (bytes[i] == 10) {
-      res += "\\n";
-    } else if (bytes[i] == 11) {
-      res += "\\v";
-    } else if (bytes[i] == 12) {
-      res += "\\f";
-    } else if (bytes[i] == 13) {
-      res += "\\r";
-    } else if (bytes[i] == 27) {
-      res += "\\e";
-    } else if (bytes[i] == 34) {
-      res += "\\\"";
-    } else if (bytes[i] == 39) {
-      res += "\\'";
-    } else if (bytes[i] == 92) {
-      res += "\\\\";
-    } else if (bytes[i] < 32 || bytes[i] > 127) {
-      sprintf(buf, "\\x%02X", bytes[i]);
-      res += buf;
+void S21SIM::add_profile_query(const std::string &code,
+                               const std::vector<uint8_t> &response,
+                               float nak_rate, uint32_t latency_ms,
+                               uint8_t checksum_offset) {
+  uint16_t nak_permille = nak_rate * 1000 + 0.5f;
+  this->profile[code] = {response, nak_permille, latency_ms, checksum_offset};
+  // F1 and F5 keep tracking D1/D5; the captured reply is where they start.
+  if (code == "F1" && response.size() >= 6) {
+    std::copy(response.begin() + 2, response.begin() + 6, this->basic);
+  } else if (code == "F5" && response.size() >= 3) {
+    this->swing = response[2];
+  }
+}
+
+void S21SIM::start_scenario() {
+  ESP_LOGI(TAG, "%s: Starting scenario (%u steps)", this->name.c_str(),
+           (unsigned) this->scenario.size());
+  this->scenario_started = true;
+  this->scenario_reported = false;
+  this->scenario_start = millis();
+  this->next_step = 0;
+  this->watches.clear();
+  this->steps_passed = 0;
+  this->steps_failed = 0;
+}
+
+void S21SIM::run_scenario() {
+  if (!this->scenario_started) {
+    if (this->scenario.empty())
+      return;
+    this->start_scenario();
+  }
+  uint32_t now = millis();
+  while (this->next_step < this->scenario.size() &&
+         now - this->scenario_start >= this->scenario[this->next_step].at_ms) {
+    this->apply_step(this->next_step++);
+  }
+  if (this->defrosting && now - this->defrost_start >= this->defrost_ms) {
+    ESP_LOGI(TAG, "%s: Defrost finished", this->name.c_str());
+    this->defrosting = false;
+  }
+  for (size_t i = 0; i < this->watches.size(); i++) {
+    const Watch &w = this->watches[i];
+    const S21ScenarioStep &step = this->scenario[w.step];
+    if (w.since == 0 && !this->disconnected) {
+      // Link back up: the master can start catching up now.
+      this->watches[i].since = now;
+    } else if (w.since != 0 && step.expect_ms != 0 &&
+               now - w.since > step.expect_ms) {
+      ESP_LOGW(TAG, "%s: FAIL step %u (%s): not observed within %" PRIu32 "ms",
+               this->name.c_str(), (unsigned) w.step,
+               s21_scenario_action_to_string(step.action), step.expect_ms);
+      this->steps_failed++;
+      this->watches.erase(this->watches.begin() + i--);
+    }
+  }
+  if (!this->scenario_reported && this->next_step == this->scenario.size() &&
+      this->watches.empty()) {
+    this->scenario_reported = true;
+    ESP_LOGI(TAG, "%s: Scenario finished: %u passed, %u failed",
+             this->name.c_str(), this->steps_passed, this->steps_failed);
+  }
+}
+
+void S21SIM::apply_step(size_t index) {
+  const S21ScenarioStep &step = this->scenario[index];
+  ESP_LOGI(TAG, "%s: Scenario step %u: %s %" PRId32, this->name.c_str(),
+           (unsigned) index, s21_scenario_action_to_string(step.action),
+           step.value);
+  switch (step.action) {
+    case S21ScenarioAction::Setpoint:
+      this->basic[2] = c10_to_setpoint_byte(step.value);
+      break;
+    case S21ScenarioAction::Power:
+      this->basic[0] = step.value ? '1' : '0';
+      break;
+    case S21ScenarioAction::Mode:
+      this->basic[1] = step.value;
+      break;
+    case S21ScenarioAction::Fan:
+      this->basic[3] = step.value;
+      break;
+    case S21ScenarioAction::Defrost:
+      this->defrosting = true;
+      this->defrost_start = millis();
+      this->defrost_ms = step.value;
+      break;
+    case S21ScenarioAction::Reboot:
+      std::copy(S21_SIM_DEFAULT_BASIC, S21_SIM_DEFAULT_BASIC + 4, this->basic);
+      this->swing = '0';
+      this->defrosting = false;
+      this->inject_fault(S21Fault::Disconnect, step.value);
+      break;
+    case S21ScenarioAction::Disconnect:
+      this->inject_fault(S21Fault::Disconnect, step.value);
+      break;
+  }
+  uint32_t since = s21_scenario_is_outage(step.action) ? 0 : millis();
+  this->watches.push_back({index, since});
+}
+
+// Called when the master acknowledges the response to code, sent at
+// sent_ms. A watched step counts as observed once the master has taken a
+// reply to the query that reports it, sent after the step took effect.
+void S21SIM::observe(const std::string &code, uint32_t sent_ms) {
+  uint32_t now = millis();
+  for (size_t i = 0; i < this->watches.size(); i++) {
+    const Watch &w = this->watches[i];
+    const S21ScenarioStep &step = this->scenario[w.step];
+    if (w.since == 0 || (int32_t) (sent_ms - w.since) < 0 ||
+        code != s21_scenario_observed_by(step.action)) {
+      continue;
+    }
+    uint32_t elapsed = now - w.since;
+    bool pass = step.expect_ms == 0 || elapsed <= step.expect_ms;
+    ESP_LOGI(TAG, "%s: %s step %u (%s): observed after %" PRIu32 "ms",
+             this->name.c_str(), pass ? "PASS" : "FAIL", (unsigned) w.step,
+             s21_scenario_action_to_string(step.action), elapsed);
+    if (pass) {
+      this->steps_passed++;
     } else {
-      res += bytes[i];
+      this->steps_failed++;
     }
+    this->watches.erase(this->watches.begin() + i--);
   }
-  return res;
 }
 
-std::string str_repr(std::vector<uint8_t> &bytes) {
-  return str_repr(&bytes[0], bytes.size());
+void S21SIM::send_garbage() {
+  uint8_t buf[S21_SIM_GARBAGE_BYTES];
+  for (size_t i = 0; i < sizeof(buf); i++) {
+    buf[i] = random_uint32() & 0xFF;
+  }
+  this->send(buf, sizeof(buf));
 }
 
-void S21SIM::dump_config() { ESP_LOGCONFIG(TAG, "S21 Sim"); }
+void S21SIM::reply(S21Reply reply) {
+  uint32_t now = micros();
+  if ((int32_t) (this->tx_done_us - now) > 0)
+    now = this->tx_done_us;
+  this->timing.on_reply(reply, now);
+}
 
 bool S21SIM::read_frame(std::vector<uint8_t> &payload) {
   uint8_t byte;
-  std::vector<uint8_t> bytes;
-  uint32_t start = millis();
-  bool reading = false;
-  while (true) {
-    if (millis() - start > S21_RESPONSE_TIMEOUT) {
-      ESP_LOGW(TAG, "Timeout waiting for frame");
-      return false;
+  if (this->frame.is_reading() &&
+      millis() - this->frame_start > S21_RESPONSE_TIMEOUT) {
+    ESP_LOGW(TAG, "%s: Timeout waiting for end of frame", this->name.c_str());
+    this->frame.reset();
+  }
+  while (this->available()) {
+    this->read_byte(&byte);
+    uint32_t acked = this->timing.acked_frames;
+    this->timing.on_rx(byte, micros());
+    if (this->timing.acked_frames != acked) {
+      this->observe(this->response_code, this->response_ms);
     }
-    while (this->available()) {
-      this->read_byte(&byte);
-      if (byte == ACK) {
-        ESP_LOGW(TAG, "Got ACK waiting to read start of frame");
-        continue;
-      } else if (!reading && byte != STX) {
-        ESP_LOGW(TAG, "Unexpected byte waiting to read start of frame: 0x%02X",
-                 byte);
-        continue;
-      } else if (byte == STX) {
-        reading = true;
-        continue;
-      }
-      if (byte == ETX) {
-        reading = false;
-        uint8_t frame_csum = bytes[bytes.size() - 1];
-        bytes.pop_back();
-        uint8_t calc_csum = s21_checksum(bytes);
-        if (calc_csum != frame_csum) {
-          ESP_LOGW(TAG, "Checksum mismatch: %x (frame) != %x (calc from %s)",
-                   frame_csum, calc_csum,
-                   hex_repr(&bytes[0], bytes.size()).c_str());
-          return false;
+    switch (this->frame.feed(byte)) {
+      case FrameResult::Pending:
+        if (byte == STX) {
+          this->frame_start = millis();
+          this->junk = 0;
         }
         break;
-      }
-      bytes.push_back(byte);
+      case FrameResult::UnexpectedAck:
+        // Normally the master acknowledging the last response; the timing
+        // counters flag the ones that aren't.
+        break;
+      case FrameResult::UnexpectedByte:
+        // Only the first stray byte is logged; a noise burst would otherwise
+        // log every byte.
+        if (this->junk++ == 0) {
+          ESP_LOGW(TAG,
+                   "%s: Unexpected byte waiting to read start of frame: 0x%02X",
+                   this->name.c_str(), byte);
+        }
+        break;
+      case FrameResult::Overflow:
+        ESP_LOGW(TAG, "%s: Frame too long, discarded", this->name.c_str());
+        break;
+      case FrameResult::ChecksumError:
+        ESP_LOGW(TAG, "%s: Checksum mismatch: %x (frame) != %x (calc from %s)",
+                 this->name.c_str(), this->frame.received_checksum(),
+                 this->frame.computed_checksum(),
+                 hex_repr(this->frame.data(), this->frame.size()).c_str());
+        return false;
+      case FrameResult::Frame:
+        payload.assign(this->frame.data(),
+                       this->frame.data() + this->frame.size());
+        return true;
     }
-    if (bytes.size() && !reading)
-      break;
-    yield();
   }
-  payload.assign(bytes.begin(), bytes.end());
-  return true;
+  return false;
 }
 
-void S21SIM::write_frame(std::vector<uint8_t> payload) {
-  ESP_LOGD(TAG, "Sending: %s", str_repr(payload).c_str());
-  this->write_byte(STX);
-  this->write_array(payload);
-  this->write_byte(s21_checksum(&payload[0], payload.size()));
-  this->write_byte(ETX);
-  this->flush();
+void S21SIM::send(const uint8_t *bytes, size_t len) {
+  // No flush, which would block every other unit until the bytes are out;
+  // track when the UART will be done with them instead.
+  uint32_t now = micros();
+  if ((int32_t) (this->tx_done_us - now) < 0)
+    this->tx_done_us = now;
+  this->tx_done_us += len * this->byte_time_us;
+  this->write_array(bytes, len);
 }
 
-void S21SIM::respond(std::vector<uint8_t> payload) {
-  this->write_byte(ACK);
-  this->write_frame(payload);
+void S21SIM::write_frame(std::vector<uint8_t> payload,
+                         uint8_t checksum_offset) {
+  uint8_t buf[S21_MAX_ENCODED_SIZE];
+  ESP_LOGD(TAG, "%s: Sending: %s", this->name.c_str(),
+           str_repr(payload).c_str());
+  size_t len = encode_frame(payload.data(), payload.size(), buf);
+  buf[len - 2] += checksum_offset;
+  if (this->bad_checksum_pending) {
+    this->bad_checksum_pending = false;
+    buf[len - 2] ^= 0x55;
+  }
+  this->send(buf, len);
+}
+
+void S21SIM::respond(std::vector<uint8_t> payload, uint8_t checksum_offset) {
+  // A unit's own checksum quirk is what the master has to live with; only
+  // an injected fault counts as corrupt.
+  bool corrupt = this->bad_checksum_pending;
+  this->send(&ACK, 1);
+  this->write_frame(payload, checksum_offset);
+  this->reply(corrupt ? S21Reply::CorruptFrame : S21Reply::Frame);
 }
 
 void S21SIM::loop() {
-  if (this->available()) {
-    std::vector<uint8_t> req;
-    this->read_frame(req);
-    ESP_LOGD(TAG, "Received req: %s", str_repr(req).c_str());
+  this->run_scenario();
+  if (this->disconnected) {
+    if (millis() - this->disconnect_start < this->disconnect_ms) {
+      // Cable unplugged: everything the master sends is lost.
+      uint8_t byte;
+      while (this->available()) {
+        this->read_byte(&byte);
+      }
+      this->frame.reset();
+      this->timing.link_lost();
+      return;
+    }
+    ESP_LOGI(TAG, "%s: Reconnected", this->name.c_str());
+    this->disconnected = false;
+  }
+  this->timing.check(micros());
+  if (this->delayed.active && (int32_t) (millis() - this->delayed.at) >= 0) {
+    this->delayed.active = false;
+    this->answer(this->delayed.code, this->delayed.res, this->delayed.nak,
+                 this->delayed.checksum_offset);
+  }
+  std::vector<uint8_t> req;
+  if (this->read_frame(req)) {
+    ESP_LOGD(TAG, "%s: Received req: %s", this->name.c_str(),
+             str_repr(req).c_str());
+    if (this->lost_ack_pending) {
+      this->lost_ack_pending = false;
+      ESP_LOGD(TAG, "%s: Dropping reply", this->name.c_str());
+      this->reply(S21Reply::None);
+      return;
+    }
+    if (this->garbage_pending) {
+      this->garbage_pending = false;
+      this->send_garbage();
+      this->reply(S21Reply::None);
+      return;
+    }
     this->handle_req(req);
   }
 }
 
 void S21SIM::handle_req(std::vector<uint8_t> req) {
-  std::string code;
-  for (auto i = 0; i < req.size(); i++) {
-    code += req[i];
-  }
+  std::string code(req.begin(), req.end());
   std::vector<uint8_t> res;
 
-  if (code == "F1") {
-    res.assign({'G', '1', '1', '3', 'K', 'A'});
+  if (req.size() == 6 && req[0] == 'D' && req[1] == '1') {
+    // power, mode, setpoint, fan
+    uint8_t setpoint = this->basic[2];
+    std::copy(req.begin() + 2, req.end(), this->basic);
+    if (!this->echo_unused_fields) {
+      if (this->basic[1] == '2' || this->basic[1] == '6') {
+        this->basic[2] = setpoint;
+      }
+      if (this->basic[1] == '2') {
+        this->basic[3] = 'A';
+      }
+    }
+    ESP_LOGI(TAG, "%s: Basic state set: %s", this->name.c_str(),
+             str_repr(this->basic, 4).c_str());
+    this->send(&ACK, 1);
+    this->reply(S21Reply::Ack);
+    return;
+  } else if (req.size() == 6 && req[0] == 'D' && req[1] == '5') {
+    this->swing = req[2];
+    ESP_LOGI(TAG, "%s: Swing set: %c", this->name.c_str(), this->swing);
+    this->send(&ACK, 1);
+    this->reply(S21Reply::Ack);
+    return;
+  }
+
+  const S21SimQuery *query = nullptr;
+  auto it = this->profile.find(code);
+  if (it != this->profile.end()) {
+    query = &it->second;
+  }
+  bool nak = query != nullptr && query->nak_permille > 0 &&
+             random_uint32() % 1000 < query->nak_permille;
+  // Replies that follow the simulated state win over captured ones.
+  bool live = code == "F1" || code == "F5" ||
+              (this->defrosting && (code == "RI" || code == "RL"));
+
+  if (nak) {
+    // Unsupported or flaky on the profiled unit
+  } else if (query != nullptr && !live && !query->response.empty()) {
+    res = query->response;
+  } else if (code == "F1") {
+    res.assign({'G', '1', this->basic[0], this->basic[1], this->basic[2],
+                this->basic[3]});
   } else if (code == "F2") {
     res.assign({'G', '2', '=', ';', 0x00, 0x80});
   } else if (code == "F3") {
@@ -182,7 +443,7 @@ void S21SIM::handle_req(std::vector<uint8_t> req) {
   } else if (code == "F4") {
     res.assign({'G', '4', '0', 0x00, 0x80, 0x00});
   } else if (code == "F5") {
-    res.assign({'G', '5', '0', '0', '0', 0x80});  // Not swinging
+    res.assign({'G', '5', this->swing, '0', '0', 0x80});
   } else if (code == "F6") {
     // nak
   } else if (code == "F7") {
@@ -195,12 +456,18 @@ void S21SIM::handle_req(std::vector<uint8_t> req) {
     // nak
   } else if (code == "RH") {    // Inside temp
     res.assign({'S', 'H', '0', '3', '2', '+'});
+  } else if (code == "RI" && this->defrosting) {
+    res.assign({'S', 'I', '0', '5', '1', '+'});  // Coil warming up
   } else if (code == "RI") {    // Coil temp ?
     res.assign({'S', 'I', '0', '9', '0', '+'});
   } else if (code == "Ra") {    // Outside temp
     res.assign({'S', 'a', '5', '1', '2', '+'});
   } else if (code == "RL") {    // Fan speed
-    res.assign({'S', 'L', '0', '9', '0'});
+    if (this->defrosting) {
+      res.assign({'S', 'L', '0', '0', '0'});
+    } else {
+      res.assign({'S', 'L', '0', '9', '0'});
+    }
   } else if (code == "RN") {    // ????
     res.assign({'S', 'N', '9', '5', '0', '+'});
   } else if (code == "RX") {    // ????
@@ -210,15 +477,33 @@ void S21SIM::handle_req(std::vector<uint8_t> req) {
   } else if (code == "M") {     // ????
     res.assign({'M', '3', 'E', '5', '3'});
   } else {
-    this->write_byte(NAK);
+    nak = true;
   }
 
-  if (res.size()) {
-    this->respond(res);
-  } else {
-    ESP_LOGE(TAG, "Unknown request: %s (%s)", str_repr(req).c_str(),
-             hex_repr(req).c_str());
+  if (!nak && res.empty()) {
+    ESP_LOGE(TAG, "%s: Unknown request: %s (%s)", this->name.c_str(),
+             str_repr(req).c_str(), hex_repr(req).c_str());
+    return;
+  }
+  uint8_t checksum_offset = query != nullptr ? query->checksum_offset : 0;
+  if (query != nullptr && query->latency_ms > 0) {
+    this->delayed = {true, code, res, nak, checksum_offset,
+                     millis() + query->latency_ms};
+    return;
+  }
+  this->answer(code, res, nak, checksum_offset);
+}
+
+void S21SIM::answer(const std::string &code, const std::vector<uint8_t> &res,
+                    bool nak, uint8_t checksum_offset) {
+  if (nak) {
+    this->send(&NAK, 1);
+    this->reply(S21Reply::Nak);
+    return;
   }
+  this->respond(res, checksum_offset);
+  this->response_code = code;
+  this->response_ms = millis();
 }
 
 }  // namespace s21_sim
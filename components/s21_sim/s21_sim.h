@@ -1,26 +1,168 @@
 #pragma once
 
+#include <map>
+#include "esphome/components/s21_protocol/s21_protocol.h"
 #include "esphome/components/uart/uart.h"
+#include "esphome/core/automation.h"
 #include "esphome/core/component.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+#include "s21_master_timing.h"
+#include "s21_scenario.h"
 
 namespace esphome {
 namespace s21_sim {
 
+// Link faults the simulator can inject, to exercise the master's recovery.
+enum class S21Fault : uint8_t {
+  LostAck,       // Next request gets no reply at all
+  BadChecksum,   // Next response frame has a corrupted checksum
+  Disconnect,    // Nothing is received or sent for the given duration
+  GarbageBurst,  // Next request is answered with random bytes only
+};
+
+const char *s21_fault_to_string(S21Fault fault);
+
+// How a modelled unit answers one query, typically generated from captured
+// traffic by tools/s21_sim_profile.py.
+struct S21SimQuery {
+  std::vector<uint8_t> response;  // Payload; F1/F5 only seed the state
+  uint16_t nak_permille;          // 1000: not supported at all
+  uint32_t latency_ms;            // Request received -> ACK and response
+  uint8_t checksum_offset;        // Added to the response checksum
+};
+
 class S21SIM : public Component, public uart::UARTDevice {
  public:
+  void setup() override;
   void loop() override;
   void dump_config() override;
+  // Prefixes log lines, to tell units apart when several are simulated.
+  void set_name(const std::string &name) { this->name = name; }
   // void set_uarts(uart::UARTComponent *tx, uart::UARTComponent *rx);
 
   bool read_frame(std::vector<uint8_t> &payload);
-  void write_frame(std::vector<uint8_t> payload);
-  void respond(std::vector<uint8_t> payload);
+  void write_frame(std::vector<uint8_t> payload, uint8_t checksum_offset = 0);
+  void respond(std::vector<uint8_t> payload, uint8_t checksum_offset = 0);
 
   void handle_req(std::vector<uint8_t> req);
 
+  void inject_fault(S21Fault fault, uint32_t duration_ms);
+
+  void add_profile_query(const std::string &code,
+                         const std::vector<uint8_t> &response, float nak_rate,
+                         uint32_t latency_ms, uint8_t checksum_offset);
+
+  void add_scenario_step(S21ScenarioAction action, int32_t value,
+                         uint32_t at_ms, uint32_t expect_ms) {
+    this->scenario.push_back({at_ms, action, value, expect_ms});
+  }
+  // (Re)starts the scenario from its first step. Also done on the first
+  // loop() if any steps are configured.
+  void start_scenario();
+  // Every step has run and was either observed or timed out.
+  bool is_scenario_finished() { return this->scenario_reported; }
+  uint8_t get_steps_passed() { return this->steps_passed; }
+  uint8_t get_steps_failed() { return this->steps_failed; }
+
+  // Logs what the master did since the last report, then starts over.
+  void set_timing_report_interval(uint32_t ms) {
+    this->timing_report_interval = ms;
+  }
+  void report_timing();
+
+  // Like most real units, keep the old setpoint in fan and dry modes and
+  // report auto fan in dry, whatever D1 asked for.
+  void set_echo_unused_fields(bool echo) { this->echo_unused_fields = echo; }
+
  protected:
+  void send_garbage();
+  void send(const uint8_t *bytes, size_t len);
+  void reply(S21Reply reply);
+  void answer(const std::string &code, const std::vector<uint8_t> &res,
+              bool nak, uint8_t checksum_offset);
+  void run_scenario();
+  void apply_step(size_t index);
+  void observe(const std::string &code, uint32_t sent_ms);
+
+  // A step whose effect the master hasn't seen yet.
+  struct Watch {
+    size_t step;
+    uint32_t since;  // 0 while the link is still down
+  };
+  std::vector<S21ScenarioStep> scenario;
+  bool scenario_started = false;
+  bool scenario_reported = false;
+  uint32_t scenario_start = 0;
+  size_t next_step = 0;
+  std::vector<Watch> watches;
+  uint8_t steps_passed = 0;
+  uint8_t steps_failed = 0;
+  bool defrosting = false;
+  uint32_t defrost_start = 0;
+  uint32_t defrost_ms = 0;
+  // Last response frame sent, for observe() once the master ACKs it.
+  std::string response_code;
+  uint32_t response_ms = 0;
+
+  std::string name;
+  HighFrequencyLoopRequester high_freq;
+  // Request being received; loop() never waits for the rest of it.
+  s21_protocol::FrameAssembler frame;
+  uint32_t frame_start = 0;
+  uint32_t junk = 0;
+  uint32_t byte_time_us = 5000;  // 12 bits at 2400 baud
+  uint32_t tx_done_us = 0;  // When the UART will have sent what's queued
+
+  std::map<std::string, S21SimQuery> profile;
+  // Reply held back to model the unit's response latency.
+  struct Delayed {
+    bool active;
+    std::string code;
+    std::vector<uint8_t> res;
+    bool nak;
+    uint8_t checksum_offset;
+    uint32_t at;
+  };
+  Delayed delayed{};
+
+  S21MasterTiming timing;
+  uint32_t timing_report_interval = 60000;
+  uint32_t timing_start = 0;
+
+  bool lost_ack_pending = false;
+  bool bad_checksum_pending = false;
+  bool garbage_pending = false;
+  bool disconnected = false;
+  uint32_t disconnect_start = 0;
+  uint32_t disconnect_ms = 0;
+
+  // State set by D1/D5 and reported back by F1/F5.
+  uint8_t basic[4] = {'1', '3', 'K', 'A'};  // On, cool, 23.5C, auto fan
+  uint8_t swing = '0';
+  bool echo_unused_fields = true;
   // UARTDevicePair *uart;
 };
 
+template<typename... Ts>
+class StartScenarioAction : public Action<Ts...>, public Parented<S21SIM> {
+ public:
+  void play(Ts... x) override { this->parent_->start_scenario(); }
+};
+
+template<typename... Ts>
+class InjectFaultAction : public Action<Ts...>, public Parented<S21SIM> {
+ public:
+  void set_fault(S21Fault fault) { this->fault = fault; }
+  TEMPLATABLE_VALUE(uint32_t, duration)
+
+  void play(Ts... x) override {
+    this->parent_->inject_fault(this->fault, this->duration_.value(x...));
+  }
+
+ protected:
+  S21Fault fault = S21Fault::LostAck;
+};
+
 }  // namespace s21_sim
 }  // namespace esphome
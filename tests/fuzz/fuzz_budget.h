@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+// CPU time a single input may take, in microseconds. A frame or response
+// costs a few microseconds even under the sanitizers; a per-byte logging or
+// quadratic path on a 4 KiB input goes straight through this.
+#ifndef S21_FUZZ_BUDGET_US
+#define S21_FUZZ_BUDGET_US 20000
+#endif
+
+// Aborts, which fails the fuzz run like a crash, if the input it was
+// created for took longer than the budget.
+class S21FuzzBudget {
+ public:
+  explicit S21FuzzBudget(size_t size) : size(size), start(clock()) {}
+  ~S21FuzzBudget() {
+    long us = (long) ((clock() - this->start) * 1000000.0 / CLOCKS_PER_SEC);
+    if (us > S21_FUZZ_BUDGET_US) {
+      fprintf(stderr, "Input of %zu bytes took %ldus, budget is %dus\n",
+              this->size, us, S21_FUZZ_BUDGET_US);
+      abort();
+    }
+  }
+
+ protected:
+  size_t size;
+  clock_t start;
+};
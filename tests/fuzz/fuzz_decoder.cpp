@@ -0,0 +1,32 @@
+// DaikinS21::parse_response on arbitrary responses. The first byte picks
+// the code length, the rest is split into code and payload.
+
+#include "esphome/components/daikin_s21/s21.h"
+#include "fuzz_budget.h"
+#include "host.h"
+
+using namespace esphome;
+using namespace esphome::daikin_s21;
+
+class FuzzDaikinS21 : public DaikinS21 {
+ public:
+  using DaikinS21::parse_response;
+};
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  static FuzzDaikinS21 *s21 = []() {
+    host::log_level = ESPHOME_LOG_LEVEL_NONE;
+    return new FuzzDaikinS21();
+  }();
+  S21FuzzBudget budget(size);
+  if (size == 0)
+    return 0;
+  size_t code_len = 1 + data[0] % 2;
+  data++;
+  size--;
+  if (code_len > size)
+    code_len = size;
+  s21->parse_response(std::vector<uint8_t>(data, data + code_len),
+                      std::vector<uint8_t>(data + code_len, data + size));
+  return 0;
+}
@@ -0,0 +1,28 @@
+// FrameAssembler and s21_payload_size on arbitrary line bytes.
+
+#include "esphome/components/s21_protocol/s21_protocol.h"
+#include "fuzz_budget.h"
+#include "host.h"
+
+using namespace esphome::s21_protocol;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  S21FuzzBudget budget(size);
+  FrameAssembler assembler;
+  for (size_t i = 0; i < size; i++) {
+    FrameResult result = assembler.feed(data[i]);
+    if (result == FrameResult::Frame) {
+      HOST_CHECK(assembler.size() <= S21_MAX_FRAME_SIZE);
+      HOST_CHECK(assembler.received_checksum() ==
+                 s21_checksum(assembler.data(), assembler.size()));
+      if (assembler.size() >= 2) {
+        size_t need = s21_payload_size(assembler.data()[0],
+                                       assembler.data()[1]);
+        HOST_CHECK(need <= S21_MAX_FRAME_SIZE);
+      }
+    } else if (result == FrameResult::ChecksumError) {
+      HOST_CHECK(assembler.size() <= S21_MAX_FRAME_SIZE);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,87 @@
+// Runs a fuzz target without libFuzzer, for compilers that don't have it:
+// every file named on the command line, then pseudo-random inputs made
+// mostly of protocol bytes, then a few known worst cases. Set S21_FUZZ_RUNS
+// to change the number of random inputs.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static const uint8_t ALPHABET[] = {
+    0x02, 0x03, 0x06, 0x15, '0', '1', '2', '3', '5', '7', '9', '+', '-',
+    'D',  'F',  'G',  'M',  'R', 'S', 'Y', 'H', 'I', 'L', 'a', 'd', 'K'};
+
+static uint32_t next_random(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+static long run(const std::vector<uint8_t> &input) {
+  clock_t start = clock();
+  LLVMFuzzerTestOneInput(input.data(), input.size());
+  return (long) ((clock() - start) * 1000000.0 / CLOCKS_PER_SEC);
+}
+
+int main(int argc, char **argv) {
+  long slowest = 0;
+  size_t inputs = 0;
+  for (int i = 1; i < argc; i++) {
+    FILE *f = fopen(argv[i], "rb");
+    if (f == nullptr) {
+      perror(argv[i]);
+      return 1;
+    }
+    std::vector<uint8_t> input;
+    int c;
+    while ((c = fgetc(f)) != EOF)
+      input.push_back(c);
+    fclose(f);
+    long us = run(input);
+    slowest = us > slowest ? us : slowest;
+    inputs++;
+  }
+
+  const char *env = getenv("S21_FUZZ_RUNS");
+  uint32_t runs = env != nullptr ? atoi(env) : 20000;
+  uint32_t state = 0x5321;
+  std::vector<uint8_t> input;
+  for (uint32_t i = 0; i < runs; i++) {
+    size_t len = i % 64 == 0 ? 4096 : next_random(&state) % 64;
+    input.resize(len);
+    for (auto &b : input) {
+      uint32_t r = next_random(&state);
+      b = r % 8 == 0 ? (uint8_t) (r >> 8)
+                     : ALPHABET[(r >> 8) % sizeof(ALPHABET)];
+    }
+    long us = run(input);
+    slowest = us > slowest ? us : slowest;
+    inputs++;
+  }
+
+  // Noise floods, a frame that never ends, and back to back empty frames.
+  std::vector<std::vector<uint8_t>> worst = {
+      std::vector<uint8_t>(4096, 0x55), std::vector<uint8_t>(4096, 0x02),
+      std::vector<uint8_t>(4096, 'G'), std::vector<uint8_t>(4096, 0x06)};
+  worst[2][0] = 0x02;
+  std::vector<uint8_t> empty;
+  for (int i = 0; i < 2048; i++) {
+    empty.push_back(0x02);
+    empty.push_back(0x03);
+  }
+  worst.push_back(empty);
+  for (auto &w : worst) {
+    long us = run(w);
+    slowest = us > slowest ? us : slowest;
+    inputs++;
+  }
+
+  printf("%zu inputs, slowest %ldus\n", inputs, slowest);
+  return 0;
+}
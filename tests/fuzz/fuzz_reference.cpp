@@ -0,0 +1,20 @@
+// The reference frame reader and decoder on arbitrary line bytes.
+
+#include <vector>
+#include "esphome/components/daikin_s21/s21_reference.h"
+#include "fuzz_budget.h"
+#include "host.h"
+
+using namespace esphome::daikin_s21;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  S21FuzzBudget budget(size);
+  std::vector<uint8_t> bytes(data, data + size);
+  std::vector<uint8_t> frame;
+  if (s21_reference_unframe(bytes, frame) != S21ReferenceFrame::Frame)
+    return 0;
+  S21DecodedState state;
+  size_t code_len = !frame.empty() && frame[0] == 'M' ? 1 : 2;
+  s21_reference_decode(frame, code_len, state);
+  return 0;
+}
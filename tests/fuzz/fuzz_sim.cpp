@@ -0,0 +1,22 @@
+// S21SIM::handle_req on arbitrary request payloads. Replies go out on a
+// serial line with nothing on the other end.
+
+#include "esphome/components/s21_sim/s21_sim.h"
+#include "fuzz_budget.h"
+#include "host.h"
+
+using namespace esphome;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  static s21_sim::S21SIM *sim = []() {
+    host::log_level = ESPHOME_LOG_LEVEL_NONE;
+    auto *sim = new s21_sim::S21SIM();
+    sim->set_uart_parent(new host::HostUart());
+    sim->set_timing_report_interval(0);
+    sim->setup();
+    return sim;
+  }();
+  S21FuzzBudget budget(size);
+  sim->handle_req(std::vector<uint8_t>(data, data + size));
+  return 0;
+}
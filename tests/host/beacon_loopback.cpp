@@ -0,0 +1,55 @@
+// Encodes a beacon with every field set and prints it as hex, for
+// beacon_loopback.py to decode with the receiver's struct layout. Also
+// checks which changes state_differs treats as worth a beacon.
+
+#include <cstdio>
+#include "esphome/components/daikin_s21/s21_beacon.h"
+#include "host.h"
+
+using namespace esphome::daikin_s21;
+
+int main() {
+  S21Beacon b;
+  b.flags = S21_BEACON_FLAG_POWER | S21_BEACON_FLAG_SWING_V |
+            S21_BEACON_FLAG_READY | S21_BEACON_FLAG_HEARTBEAT;
+  b.mode = '4';
+  b.fan = 'B';
+  b.node_id = 0x89ABCDEF;
+  b.seq = 123456;
+  b.setpoint = 215;
+  b.temp_inside = 198;
+  b.temp_outside = -52;
+  b.temp_coil = 351;
+  b.fan_rpm = 1240;
+  b.transactions = 4000000000u;
+  b.naks = 7;
+  b.timeouts = 65536;
+  b.checksum_errors = 3;
+  b.uptime_s = 86400;
+  snprintf(b.name, sizeof(b.name), "%s", "living-room-ac-1");
+
+  uint8_t buf[S21_BEACON_SIZE];
+  encode_s21_beacon(b, buf);
+  S21Beacon decoded;
+  HOST_CHECK(decode_s21_beacon(buf, sizeof(buf), &decoded));
+  HOST_CHECK(!decoded.state_differs(b) && decoded.seq == b.seq);
+
+  S21Beacon other = b;
+  other.temp_coil += 50;
+  other.fan_rpm += 300;
+  other.temp_inside += S21_BEACON_TEMP_STEP - 1;
+  other.transactions++;
+  other.flags &= ~S21_BEACON_FLAG_HEARTBEAT;
+  HOST_CHECK(!other.state_differs(b));
+  other.temp_outside -= S21_BEACON_TEMP_STEP;
+  HOST_CHECK(other.state_differs(b));
+  other = b;
+  other.setpoint += 5;
+  HOST_CHECK(other.state_differs(b));
+
+  for (uint8_t byte : buf) {
+    printf("%02x", byte);
+  }
+  printf("\n");
+  return 0;
+}
@@ -0,0 +1,54 @@
+"""
+Decodes a beacon encoded by beacon_loopback (C++) with tools/s21_beacon.py,
+so the two sides of the layout can't drift apart.
+
+    python3 beacon_loopback.py <beacon_loopback binary>
+"""
+
+import os
+import subprocess
+import sys
+
+sys.path.insert(
+    0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "../../tools")
+)
+import s21_beacon  # noqa: E402
+
+
+def main():
+    out = subprocess.run([sys.argv[1]], check=True, capture_output=True, text=True)
+    data = bytes.fromhex(out.stdout.strip())
+    assert len(data) == s21_beacon.SIZE == s21_beacon.LAYOUT.size
+    beacon = s21_beacon.decode(data)
+    expected = s21_beacon.Beacon(
+        flags=s21_beacon.FLAG_POWER
+        | s21_beacon.FLAG_SWING_V
+        | s21_beacon.FLAG_READY
+        | s21_beacon.FLAG_HEARTBEAT,
+        mode="4",
+        fan="B",
+        node_id=0x89ABCDEF,
+        seq=123456,
+        setpoint=21.5,
+        temp_inside=19.8,
+        temp_outside=-5.2,
+        temp_coil=35.1,
+        fan_rpm=1240,
+        transactions=4000000000,
+        naks=7,
+        timeouts=65536,
+        checksum_errors=3,
+        uptime_s=86400,
+        name="living-room-ac-1",
+    )
+    if beacon != expected:
+        for field, got, want in zip(expected._fields, beacon, expected):
+            if got != want:
+                print(f"{field}: decoded {got!r}, encoded {want!r}")
+        sys.exit(1)
+    assert s21_beacon.decode(data[:-1]) is None
+    assert s21_beacon.decode(b"S21X" + data[4:]) is None
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,52 @@
+// Clock-aligned polling: once the clock syncs, a sensor with a longer update
+// interval than the master publishes right after the poll cycle started on
+// each wall-clock multiple of its own interval (plus the phase offset), once
+// per interval, however the node's uptime lines up with the clock.
+
+#include <vector>
+#include "esphome/components/daikin_s21/sensor/daikin_s21_sensor.h"
+#include "s21_rig.h"
+
+using namespace esphome;
+using namespace esphome::daikin_s21;
+
+#define MASTER_INTERVAL 2000
+#define SENSOR_INTERVAL 10000
+#define PHASE_OFFSET 1500
+
+int main() {
+  host::S21Rig rig(MASTER_INTERVAL);
+  time::RealTimeClock clock;
+  rig.master.set_time_alignment(&clock, PHASE_OFFSET);
+  DaikinS21Sensor sensors;
+  sensor::Sensor inside;
+  sensors.set_s21(&rig.master);
+  sensors.set_update_interval(SENSOR_INTERVAL);
+  sensors.set_temp_inside_sensor(&inside);
+  std::vector<uint64_t> published;  // Wall-clock ms
+  inside.add_on_state_callback(
+      [&](float) { published.push_back(clock.wall_ms()); });
+  HOST_CHECK(rig.start());
+  host::add_component(&sensors);
+
+  // Boot at an arbitrary wall-clock offset; free-running until then.
+  host::run_for(3700);
+  clock.sync(1700000000);
+  HOST_CHECK(host::run_until([&]() { return rig.master.is_time_aligned(); },
+                             5000));
+  published.clear();
+  host::run_for(120000);
+
+  HOST_CHECK(published.size() >= 11);
+  for (size_t i = 0; i < published.size(); i++) {
+    uint64_t since_boundary = (published[i] - PHASE_OFFSET) % SENSOR_INTERVAL;
+    // Published once the cycle's queries are through, well within a cycle.
+    HOST_CHECK(since_boundary < MASTER_INTERVAL);
+    if (i > 0) {
+      uint64_t gap = published[i] - published[i - 1];
+      HOST_CHECK(gap > SENSOR_INTERVAL - MASTER_INTERVAL &&
+                 gap < SENSOR_INTERVAL + MASTER_INTERVAL);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,39 @@
+// A unit that keeps its own setpoint in fan and dry modes and runs the fan
+// on auto in dry, like most real ones: commands to those modes still confirm
+// on the first attempt.
+
+#include "s21_rig.h"
+
+using namespace esphome;
+using namespace esphome::daikin_s21;
+
+static const S21CommandStats &climate_stats(host::S21Rig &rig) {
+  return rig.master.get_stats().commands[(size_t) S21Command::Climate];
+}
+
+// Sends a D1 and runs until the journal is done with it.
+static bool command(host::S21Rig &rig, DaikinClimateMode mode, float setpoint,
+                    DaikinFanMode fan) {
+  rig.master.set_daikin_climate_settings(true, mode, setpoint, fan);
+  return host::run_until([&rig]() { return !rig.master.is_command_pending(); },
+                         30000) &&
+         rig.master.last_command_confirmed();
+}
+
+int main() {
+  host::S21Rig rig;
+  rig.unit.set_echo_unused_fields(false);
+  HOST_CHECK(rig.start());
+
+  HOST_CHECK(command(rig, DaikinClimateMode::Fan, 18.0, DaikinFanMode::Speed3));
+  HOST_CHECK(rig.master.get_fan_mode() == DaikinFanMode::Speed3);
+  HOST_CHECK(rig.master.get_setpoint() != 18.0f);
+  HOST_CHECK(command(rig, DaikinClimateMode::Dry, 19.0, DaikinFanMode::Speed2));
+  HOST_CHECK(rig.master.get_fan_mode() == DaikinFanMode::Auto);
+  HOST_CHECK(
+      command(rig, DaikinClimateMode::Cool, 21.0, DaikinFanMode::Speed1));
+  HOST_CHECK(rig.master.get_setpoint() == 21.0f);
+  HOST_CHECK(climate_stats(rig).retries == 0);
+  HOST_CHECK(climate_stats(rig).failed == 0);
+  return 0;
+}
@@ -0,0 +1,24 @@
+// A unit whose RH reply is too short to decode: the replies are counted,
+// but the link stays healthy. No Degraded profile and no frame gap backoff.
+
+#include "s21_rig.h"
+
+using namespace esphome;
+using namespace esphome::daikin_s21;
+
+int main() {
+  host::S21Rig rig;
+  rig.unit.add_profile_query("RH", {'S', 'H', '1'}, 0.0f, 0, 0);
+  HOST_CHECK(rig.start());
+  const DaikinS21Stats &stats = rig.master.get_stats();
+  uint16_t gap = stats.frame_gap_ms;
+
+  host::run_for(60000);
+  HOST_CHECK(stats.decode_errors > 0);
+  HOST_CHECK(stats.timeouts == 0 && stats.checksum_errors == 0);
+  HOST_CHECK(stats.recoveries == 0);
+  HOST_CHECK(stats.frame_gap_ms <= gap);
+  HOST_CHECK(rig.master.get_poll_profile() != S21PollProfile::Degraded);
+  HOST_CHECK(rig.master.is_negotiated());
+  return 0;
+}
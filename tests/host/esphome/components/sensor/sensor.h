@@ -0,0 +1,33 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sensor {
+
+class Sensor {
+ public:
+  void publish_state(float state) {
+    this->state = state;
+    for (auto &callback : this->callbacks)
+      callback(state);
+  }
+  void add_on_state_callback(std::function<void(float)> &&callback) {
+    this->callbacks.push_back(std::move(callback));
+  }
+
+  float state = 0.0f;
+
+ protected:
+  std::vector<std::function<void(float)>> callbacks;
+};
+
+}  // namespace sensor
+}  // namespace esphome
+
+#define LOG_SENSOR(prefix, type, obj)        \
+  if ((obj) != nullptr) {                    \
+    ESP_LOGCONFIG("", "%s%s", prefix, type); \
+  }
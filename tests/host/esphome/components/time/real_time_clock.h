@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+
+namespace esphome {
+
+namespace host {
+uint64_t now_us();
+}  // namespace host
+
+namespace time {
+
+struct ESPTime {
+  time_t timestamp;
+  bool is_valid() const { return this->timestamp != 0; }
+};
+
+// A wall clock that is invalid until synced, then ticks with the virtual
+// clock.
+class RealTimeClock {
+ public:
+  void sync(time_t epoch) {
+    this->epoch_us = (uint64_t) epoch * 1000000 - host::now_us();
+    this->synced = true;
+  }
+  // Wall-clock time in milliseconds, for harnesses.
+  uint64_t wall_ms() { return (this->epoch_us + host::now_us()) / 1000; }
+
+  time_t timestamp_now() {
+    return this->synced ? (time_t) (this->wall_ms() / 1000) : 0;
+  }
+  ESPTime now() { return {this->timestamp_now()}; }
+
+ protected:
+  uint64_t epoch_us = 0;
+  bool synced = false;
+};
+
+}  // namespace time
+}  // namespace esphome
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <functional>
+#include "esphome/core/component.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/optional.h"
+
+namespace esphome {
+
+// Constant or lambda, like the device's TemplatableValue.
+template<typename T, typename... X> class TemplatableValue {
+ public:
+  TemplatableValue() = default;
+  TemplatableValue(T value) : value_(value), has_value_(true) {}
+  TemplatableValue(std::function<T(X...)> f) : f_(f), has_value_(true) {}
+
+  bool has_value() const { return this->has_value_; }
+  T value(X... x) { return this->f_ ? this->f_(x...) : this->value_; }
+  optional<T> optional_value(X... x) {
+    if (!this->has_value_)
+      return {};
+    return this->value(x...);
+  }
+
+ protected:
+  T value_{};
+  std::function<T(X...)> f_;
+  bool has_value_ = false;
+};
+
+#define TEMPLATABLE_VALUE_(type, name) \
+ protected: \
+  TemplatableValue<type, Ts...> name##_{}; \
+\
+ public: \
+  template<typename V> void set_##name(V name) { this->name##_ = name; }
+
+#define TEMPLATABLE_VALUE(type, name) TEMPLATABLE_VALUE_(type, name)
+
+template<typename... Ts> class Action {
+ public:
+  virtual ~Action() = default;
+  virtual void play(Ts... x) = 0;
+};
+
+template<typename... Ts> class Trigger {
+ public:
+  void trigger(Ts... x) {}
+};
+
+}  // namespace esphome
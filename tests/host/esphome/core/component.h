@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/optional.h"
+
+namespace esphome {
+
+namespace setup_priority {
+extern const float HARDWARE;
+extern const float DATA;
+extern const float AFTER_WIFI;
+extern const float LATE;
+}  // namespace setup_priority
+
+// Timers run from the host loop (host::run_for()). Named timers replace
+// earlier ones of the same name on the same component, as on the device.
+class Component {
+ public:
+  virtual ~Component() = default;
+  virtual void setup() {}
+  virtual void loop() {}
+  virtual void dump_config() {}
+  virtual float get_setup_priority() const;
+  void mark_failed() { this->failed_ = true; }
+  bool is_failed() const { return this->failed_; }
+
+ protected:
+  void set_interval(const std::string &name, uint32_t interval,
+                    std::function<void()> &&f);
+  void set_interval(uint32_t interval, std::function<void()> &&f);
+  bool cancel_interval(const std::string &name);
+  void set_timeout(const std::string &name, uint32_t timeout,
+                   std::function<void()> &&f);
+  void set_timeout(uint32_t timeout, std::function<void()> &&f);
+  bool cancel_timeout(const std::string &name);
+  void defer(std::function<void()> &&f) { this->set_timeout(0, std::move(f)); }
+  void status_set_warning() {}
+  void status_clear_warning() {}
+
+  bool failed_ = false;
+};
+
+class PollingComponent : public Component {
+ public:
+  PollingComponent() : PollingComponent(0) {}
+  explicit PollingComponent(uint32_t update_interval)
+      : update_interval_(update_interval) {}
+  virtual void update() = 0;
+  virtual void set_update_interval(uint32_t update_interval) {
+    this->update_interval_ = update_interval;
+  }
+  virtual uint32_t get_update_interval() const {
+    return this->update_interval_;
+  }
+  void start_poller();
+  void stop_poller();
+
+ protected:
+  uint32_t update_interval_;
+};
+
+}  // namespace esphome
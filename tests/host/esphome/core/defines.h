@@ -0,0 +1,3 @@
+#pragma once
+
+// Host builds get their feature defines from the compiler command line.
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome {
+
+// Virtual time, advanced by the host harness (see host.h).
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void yield();
+
+}  // namespace esphome
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "esphome/core/optional.h"
+
+namespace esphome {
+
+uint32_t fnv1_hash(const std::string &str);
+// Deterministic on the host, so runs can be repeated.
+uint32_t random_uint32();
+
+template<typename T> class Parented {
+ public:
+  Parented() = default;
+  Parented(T *parent) : parent_(parent) {}
+  T *get_parent() const { return this->parent_; }
+  void set_parent(T *parent) { this->parent_ = parent; }
+
+ protected:
+  T *parent_{nullptr};
+};
+
+template<typename... X> class CallbackManager;
+
+template<typename... Ts> class CallbackManager<void(Ts...)> {
+ public:
+  void add(std::function<void(Ts...)> &&callback) {
+    this->callbacks_.push_back(std::move(callback));
+  }
+  void call(Ts... args) {
+    for (auto &cb : this->callbacks_)
+      cb(args...);
+  }
+
+ protected:
+  std::vector<std::function<void(Ts...)>> callbacks_;
+};
+
+// The host loop always runs at full speed.
+class HighFrequencyLoopRequester {
+ public:
+  void start() {}
+  void stop() {}
+};
+
+}  // namespace esphome
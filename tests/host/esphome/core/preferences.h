@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace esphome {
+
+// RAM-only preferences; host::reset() wipes them, like a fresh flash.
+std::vector<uint8_t> *host_preference(uint32_t key, bool create);
+
+class ESPPreferenceObject {
+ public:
+  ESPPreferenceObject() = default;
+  explicit ESPPreferenceObject(uint32_t key) : key_(key) {}
+
+  template<typename T> bool save(const T *src) {
+    std::vector<uint8_t> *data = host_preference(this->key_, true);
+    data->assign((const uint8_t *) src, (const uint8_t *) src + sizeof(T));
+    return true;
+  }
+  template<typename T> bool load(T *dest) {
+    std::vector<uint8_t> *data = host_preference(this->key_, false);
+    if (data == nullptr || data->size() != sizeof(T))
+      return false;
+    memcpy(dest, data->data(), sizeof(T));
+    return true;
+  }
+
+ protected:
+  uint32_t key_ = 0;
+};
+
+class ESPPreferences {
+ public:
+  template<typename T>
+  ESPPreferenceObject make_preference(uint32_t type, bool = false) {
+    return ESPPreferenceObject(type);
+  }
+};
+
+extern ESPPreferences *global_preferences;
+
+}  // namespace esphome
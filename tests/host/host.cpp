@@ -0,0 +1,283 @@
+#include "host.h"
+#include <cstdarg>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "esphome/core/log.h"
+#include "esphome/core/preferences.h"
+
+namespace esphome {
+
+namespace setup_priority {
+const float HARDWARE = 800.0f;
+const float DATA = 600.0f;
+const float AFTER_WIFI = 200.0f;
+const float LATE = -100.0f;
+}  // namespace setup_priority
+
+namespace host {
+
+int log_level = ESPHOME_LOG_LEVEL_WARN;
+
+namespace {
+
+struct Timer {
+  Component *owner;
+  std::string name;
+  bool interval;
+  uint64_t at_us;
+  uint32_t period_ms;
+  std::function<void()> f;
+  bool cancelled;
+};
+
+uint64_t clock_us = 0;
+uint32_t random_state = 1;
+std::vector<Component *> components;
+std::vector<std::shared_ptr<Timer>> timers;
+std::map<uint32_t, std::vector<uint8_t>> preferences;
+
+void add_timer(Component *owner, const std::string &name, bool interval,
+               uint32_t ms, std::function<void()> &&f) {
+  if (!name.empty()) {
+    for (auto &t : timers) {
+      if (t->owner == owner && t->interval == interval && t->name == name)
+        t->cancelled = true;
+    }
+  }
+  timers.push_back(std::make_shared<Timer>(
+      Timer{owner, name, interval, clock_us + ms * 1000ULL, ms, std::move(f),
+            false}));
+}
+
+bool cancel_timer(Component *owner, const std::string &name, bool interval) {
+  bool found = false;
+  for (auto &t : timers) {
+    if (!t->cancelled && t->owner == owner && t->interval == interval &&
+        t->name == name) {
+      t->cancelled = true;
+      found = true;
+    }
+  }
+  return found;
+}
+
+void run_timers() {
+  // Timers added while running wait for the next step.
+  std::vector<std::shared_ptr<Timer>> due;
+  for (auto &t : timers) {
+    if (!t->cancelled && t->at_us <= clock_us)
+      due.push_back(t);
+  }
+  for (auto &t : due) {
+    if (t->cancelled)
+      continue;
+    if (t->interval) {
+      t->at_us += t->period_ms > 0 ? t->period_ms * 1000ULL : 1000;
+    } else {
+      t->cancelled = true;
+    }
+    t->f();
+  }
+  std::vector<std::shared_ptr<Timer>> live;
+  for (auto &t : timers) {
+    if (!t->cancelled)
+      live.push_back(t);
+  }
+  timers.swap(live);
+}
+
+}  // namespace
+
+uint64_t now_us() { return clock_us; }
+void advance_us(uint64_t us) { clock_us += us; }
+
+void add_component(Component *component) {
+  component->setup();
+  auto *polling = dynamic_cast<PollingComponent *>(component);
+  if (polling != nullptr)
+    polling->start_poller();
+  components.push_back(component);
+}
+
+void run_for(uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    clock_us += 1000;
+    for (Component *c : components)
+      c->loop();
+    run_timers();
+  }
+}
+
+bool run_until(const std::function<bool()> &done, uint32_t timeout_ms) {
+  for (uint32_t i = 0; i < timeout_ms; i++) {
+    if (done())
+      return true;
+    run_for(1);
+  }
+  return done();
+}
+
+void reset() {
+  components.clear();
+  timers.clear();
+  preferences.clear();
+  clock_us = 0;
+  random_state = 1;
+}
+
+HostUart::HostUart() {
+  this->baud_rate_ = 2400;
+  this->data_bits_ = 8;
+  this->parity_ = uart::UART_CONFIG_PARITY_EVEN;
+  this->stop_bits_ = 2;
+}
+
+void HostUart::connect(HostUart *peer) {
+  this->peer = peer;
+  peer->peer = this;
+}
+
+uint32_t HostUart::byte_time_us() const {
+  uint32_t bits = 1 + this->data_bits_ +
+                  (this->parity_ != uart::UART_CONFIG_PARITY_NONE) +
+                  this->stop_bits_;
+  return bits * 1000000 / this->baud_rate_;
+}
+
+void HostUart::write_array(const uint8_t *data, size_t len) {
+  uint64_t at = this->tx_done > clock_us ? this->tx_done : clock_us;
+  for (size_t i = 0; i < len; i++) {
+    at += this->byte_time_us();
+    if (this->peer != nullptr)
+      this->peer->receive(at, data[i]);
+  }
+  this->tx_done = at;
+}
+
+bool HostUart::peek_byte(uint8_t *data) {
+  if (this->available() == 0)
+    return false;
+  *data = this->rx.front().value;
+  return true;
+}
+
+bool HostUart::read_array(uint8_t *data, size_t len) {
+  if ((size_t) this->available() < len)
+    return false;
+  for (size_t i = 0; i < len; i++) {
+    data[i] = this->rx.front().value;
+    this->rx.pop_front();
+  }
+  return true;
+}
+
+int HostUart::available() {
+  int n = 0;
+  for (const Byte &b : this->rx) {
+    if (b.at > clock_us)
+      break;
+    n++;
+  }
+  return n;
+}
+
+void HostUart::flush() {
+  if (this->tx_done > clock_us)
+    clock_us = this->tx_done;
+}
+
+}  // namespace host
+
+uint32_t millis() { return (uint32_t) (host::clock_us / 1000); }
+uint32_t micros() { return (uint32_t) host::clock_us; }
+void delay(uint32_t ms) { host::clock_us += ms * 1000ULL; }
+// Code that busy-waits for serial input calls yield(); on a device time
+// passes meanwhile, so it does here too, or the input would never arrive.
+void yield() { host::clock_us += 100; }
+
+float Component::get_setup_priority() const { return setup_priority::DATA; }
+
+void Component::set_interval(const std::string &name, uint32_t interval,
+                             std::function<void()> &&f) {
+  host::add_timer(this, name, true, interval, std::move(f));
+}
+void Component::set_interval(uint32_t interval, std::function<void()> &&f) {
+  host::add_timer(this, "", true, interval, std::move(f));
+}
+bool Component::cancel_interval(const std::string &name) {
+  return host::cancel_timer(this, name, true);
+}
+void Component::set_timeout(const std::string &name, uint32_t timeout,
+                            std::function<void()> &&f) {
+  host::add_timer(this, name, false, timeout, std::move(f));
+}
+void Component::set_timeout(uint32_t timeout, std::function<void()> &&f) {
+  host::add_timer(this, "", false, timeout, std::move(f));
+}
+bool Component::cancel_timeout(const std::string &name) {
+  return host::cancel_timer(this, name, false);
+}
+
+void PollingComponent::start_poller() {
+  this->set_interval("update", this->get_update_interval(),
+                     [this]() { this->update(); });
+}
+void PollingComponent::stop_poller() { this->cancel_interval("update"); }
+
+uint32_t fnv1_hash(const std::string &str) {
+  uint32_t hash = 2166136261UL;
+  for (char c : str) {
+    hash *= 16777619UL;
+    hash ^= c;
+  }
+  return hash;
+}
+
+uint32_t random_uint32() {
+  // xorshift32
+  uint32_t x = host::random_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  host::random_state = x;
+  return x;
+}
+
+std::vector<uint8_t> *host_preference(uint32_t key, bool create) {
+  auto it = host::preferences.find(key);
+  if (it != host::preferences.end())
+    return &it->second;
+  return create ? &host::preferences[key] : nullptr;
+}
+
+static ESPPreferences host_preferences;
+ESPPreferences *global_preferences = &host_preferences;
+
+void esp_log_printf_(int level, const char *tag, const char *format, ...) {
+  if (level > host::log_level)
+    return;
+  static const char LETTERS[] = "?EWICDVV";
+  printf("%10.3f [%c][%s]: ", host::clock_us / 1e6, LETTERS[level], tag);
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+  printf("\n");
+}
+
+namespace uart {
+const char *parity_to_str(UARTParityOptions parity) {
+  switch (parity) {
+    case UART_CONFIG_PARITY_EVEN:
+      return "EVEN";
+    case UART_CONFIG_PARITY_ODD:
+      return "ODD";
+    default:
+      return "NONE";
+  }
+}
+}  // namespace uart
+
+}  // namespace esphome
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include "esphome/components/uart/uart.h"
+#include "esphome/core/component.h"
+
+// Minimal stand-in for the ESPHome runtime, so components can run on a
+// host under a virtual clock. Time only moves when the harness advances it,
+// so runs are repeatable and a simulated hour takes well under a second.
+
+namespace esphome {
+namespace host {
+
+// Messages at or below this level are printed (ESPHOME_LOG_LEVEL_*).
+extern int log_level;
+
+uint64_t now_us();
+void advance_us(uint64_t us);
+
+// Calls setup(), starts the poller of a PollingComponent, and runs loop()
+// from then on. Components run in the order they were added.
+void add_component(Component *component);
+// Runs the loop in 1ms steps: every component's loop(), then due timers.
+void run_for(uint32_t ms);
+// Runs until done() returns true; false if timeout_ms passed first.
+bool run_until(const std::function<bool()> &done, uint32_t timeout_ms);
+// Forgets components, timers and preferences and restarts the clock.
+void reset();
+
+// One end of a serial line. Bytes written arrive at the other end one byte
+// time apart, as they would on the wire at the configured baud rate.
+class HostUart : public uart::UARTComponent {
+ public:
+  // 2400 baud 8E2, as S21 units use.
+  HostUart();
+  void connect(HostUart *peer);
+
+  void write_array(const uint8_t *data, size_t len) override;
+  bool peek_byte(uint8_t *data) override;
+  bool read_array(uint8_t *data, size_t len) override;
+  int available() override;
+  // Waits until everything written has left, like the blocking device call.
+  void flush() override;
+
+  uint32_t byte_time_us() const;
+
+ protected:
+  struct Byte {
+    uint64_t at;  // Arrival time
+    uint8_t value;
+  };
+  void receive(uint64_t at, uint8_t value) { this->rx.push_back({at, value}); }
+
+  HostUart *peer{nullptr};
+  std::deque<Byte> rx;
+  uint64_t tx_done = 0;
+};
+
+}  // namespace host
+}  // namespace esphome
+
+// Fails the test with a message if cond is false; active in every build.
+#define HOST_CHECK(cond)                                                 \
+  do {                                                                   \
+    if (!(cond)) {                                                       \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+              #cond);                                                    \
+      exit(1);                                                           \
+    }                                                                    \
+  } while (0)
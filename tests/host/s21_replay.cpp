@@ -0,0 +1,387 @@
+// Replays S21 traffic through the engine and through the reference
+// implementations in s21_reference.h, and fails on any difference in framing,
+// decoded state or D1/D5 payloads. For each trace it also reports the decode
+// time per frame of both, and the engine's speedup over the reference.
+//
+//     s21_replay [trace.log ...]
+//
+// Two generated traces are always replayed: "running", clean traffic from a
+// unit in normal operation, and "noisy", random responses on a line with
+// checksum errors, truncated frames and junk. Each file named on the command
+// line is a recorded trace: the lines dump_trace() logs between BEGIN TRACE
+// and END TRACE, log prefixes and all. Responses cut short in the trace
+// (":..") are skipped. Set S21_REPLAY_ROUNDS to change how often each trace
+// is decoded for timing. Timings from a sanitizer build are only good for
+// comparing runs of the same build.
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "esphome/components/daikin_s21/s21.h"
+#include "host.h"
+
+using namespace esphome;
+using namespace esphome::daikin_s21;
+using namespace esphome::s21_protocol;
+
+class ReplayDaikinS21 : public DaikinS21 {
+ public:
+  using DaikinS21::climate_payload;
+  using DaikinS21::decoded_state;
+  using DaikinS21::parse_response;
+  using DaikinS21::swing_payload;
+};
+
+// One response as handed to parse_response.
+struct Response {
+  std::vector<uint8_t> rcode;
+  std::vector<uint8_t> payload;
+  std::vector<uint8_t> frame;  // rcode followed by payload
+};
+
+struct Trace {
+  std::string name;
+  std::vector<uint8_t> line;  // Raw bytes from the unit, if known
+  std::vector<Response> responses;
+};
+
+static uint32_t next_random(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+static Response make_response(const std::vector<uint8_t> &frame,
+                              size_t code_len) {
+  code_len = code_len < frame.size() ? code_len : frame.size();
+  Response r;
+  r.rcode.assign(frame.begin(), frame.begin() + code_len);
+  r.payload.assign(frame.begin() + code_len, frame.end());
+  r.frame = frame;
+  return r;
+}
+
+static void put_frame(std::vector<uint8_t> &line,
+                      const std::vector<uint8_t> &frame) {
+  uint8_t buf[S21_MAX_ENCODED_SIZE];
+  size_t len = encode_frame(frame.data(), frame.size(), buf);
+  line.insert(line.end(), buf, buf + len);
+}
+
+// Three digits, least significant first, then the sign.
+static std::vector<uint8_t> number(const char *code, int value) {
+  std::vector<uint8_t> frame(code, code + 2);
+  int v = value < 0 ? -value : value;
+  frame.push_back('0' + v % 10);
+  frame.push_back('0' + v / 10 % 10);
+  frame.push_back('0' + v / 100 % 10);
+  frame.push_back(value < 0 ? '-' : '+');
+  return frame;
+}
+
+// Poll cycles of a unit heating, with slowly drifting readings.
+static Trace running_trace() {
+  static const uint8_t FANS[] = {'A', 'B', '3', '4', '5', '6', '7'};
+  Trace t;
+  t.name = "running";
+  for (int i = 0; i < 500; i++) {
+    int drift = i % 40 < 20 ? i % 20 : 20 - i % 20;
+    std::vector<std::vector<uint8_t>> frames = {
+        {'G', '1', (uint8_t) (i % 50 == 0 ? '0' : '1'), '4',
+         (uint8_t) (28 + 40 + i / 100), FANS[i / 70 % 7]},
+        {'G', '5', (uint8_t) ('0' + i / 125), '?', '0', '0'},
+        {'G', '9', (uint8_t) (128 + 42 + drift), (uint8_t) (128 + drift / 2),
+         '0', '0'},
+        number("SH", 205 + drift),
+        number("SI", 340 - drift * 3),
+        number("Sa", i % 100 < 50 ? -25 - drift : 15 + drift),
+        number("SL", 80 + drift),
+        {'S', 'd', (uint8_t) (i % 25 == 0 ? '0' : '1'), '2', '0'},
+    };
+    for (auto &frame : frames) {
+      t.line.push_back(ACK);
+      put_frame(t.line, frame);
+    }
+  }
+  return t;
+}
+
+// Random responses to every query the engine knows, on a bad line.
+static Trace noisy_trace() {
+  static const char *const CODES[] = {"G1", "G5", "G8", "G9", "GY", "SH",
+                                      "SI", "Sa", "SL", "Sd", "M",  "GK"};
+  static const uint8_t ALPHABET[] = {'0', '1', '2', '3', '4', '5', '6', '7',
+                                     '8', '9', '+', '-', '?', 'A', 'B', 'K'};
+  Trace t;
+  t.name = "noisy";
+  uint32_t state = 0x5321;
+  for (int i = 0; i < 5000; i++) {
+    const char *code = CODES[next_random(&state) % 12];
+    std::vector<uint8_t> frame(code, code + strlen(code));
+    size_t len = next_random(&state) % 8;
+    for (size_t j = 0; j < len; j++) {
+      uint32_t r = next_random(&state);
+      frame.push_back(r % 8 == 0 ? (uint8_t) (r >> 8)
+                                 : ALPHABET[(r >> 8) % 16]);
+    }
+    t.line.push_back(ACK);
+    uint32_t fault = next_random(&state) % 32;
+    if (fault == 0) {
+      // Truncated: a new frame starts before this one ends.
+      t.line.push_back(STX);
+      t.line.insert(t.line.end(), frame.begin(), frame.end());
+    } else if (fault == 1) {
+      t.line.push_back((uint8_t) next_random(&state));
+    } else if (fault == 2) {
+      put_frame(t.line, frame);
+      t.line[t.line.size() - 2]++;
+      continue;
+    } else if (fault == 3) {
+      t.line.push_back(STX);
+      t.line.push_back(ETX);
+    }
+    put_frame(t.line, frame);
+  }
+  return t;
+}
+
+// Fills in the responses of a generated trace by reading its line with the
+// frame assembler, checking every frame against the reference reader the
+// way the engine does: over all bytes of a transaction, up to the ETX.
+static uint32_t read_line(Trace &t) {
+  FrameAssembler assembler;
+  std::vector<uint8_t> rx;
+  uint32_t mismatches = 0;
+  for (uint8_t byte : t.line) {
+    rx.push_back(byte);
+    FrameResult result = assembler.feed(byte);
+    if (result == FrameResult::Overflow) {
+      rx.clear();
+      continue;
+    }
+    if (result != FrameResult::Frame && result != FrameResult::ChecksumError)
+      continue;
+    std::vector<uint8_t> frame;
+    S21ReferenceFrame ref = s21_reference_unframe(rx, frame);
+    bool same = result == FrameResult::Frame
+                    ? ref == S21ReferenceFrame::Frame &&
+                          frame.size() == assembler.size() &&
+                          std::equal(frame.begin(), frame.end(),
+                                     assembler.data())
+                    : ref == S21ReferenceFrame::ChecksumError;
+    if (!same) {
+      mismatches++;
+      printf("%s: frame reader mismatch on %s\n", t.name.c_str(),
+             hex_repr(rx).c_str());
+    }
+    rx.clear();
+    if (result == FrameResult::Frame && assembler.size() > 0) {
+      std::vector<uint8_t> f(assembler.data(),
+                             assembler.data() + assembler.size());
+      t.responses.push_back(make_response(f, f[0] == 'M' ? 1 : 2));
+    }
+  }
+  return mismatches;
+}
+
+static bool parse_hex(const std::string &s, std::vector<uint8_t> &out) {
+  out.clear();
+  for (size_t i = 0; i < s.size(); i += 3) {
+    if (i + 1 >= s.size() || (i + 2 < s.size() && s[i + 2] != ':'))
+      return false;
+    char *end;
+    std::string byte = s.substr(i, 2);
+    out.push_back((uint8_t) strtoul(byte.c_str(), &end, 16));
+    if (*end != '\0')
+      return false;
+  }
+  return true;
+}
+
+// An RX entry answers the TX before it; the request's length is the length
+// of the response code, as in the engine.
+static bool load_trace(const char *path, Trace &t, size_t &skipped) {
+  FILE *f = fopen(path, "r");
+  if (f == nullptr) {
+    perror(path);
+    return false;
+  }
+  t.name = path;
+  const char *slash = strrchr(path, '/');
+  if (slash != nullptr)
+    t.name = slash + 1;
+  size_t code_len = 0;
+  char buf[512];
+  while (fgets(buf, sizeof(buf), f) != nullptr) {
+    std::vector<std::string> tokens;
+    for (char *tok = strtok(buf, " \t\r\n"); tok != nullptr;
+         tok = strtok(nullptr, " \t\r\n")) {
+      tokens.push_back(tok);
+    }
+    for (size_t i = 1; i + 1 < tokens.size(); i++) {
+      const std::string &event = tokens[i];
+      if (event != "TX" && event != "RX")
+        continue;
+      if (tokens[i - 1].find_first_not_of("0123456789") != std::string::npos)
+        continue;
+      std::vector<uint8_t> data;
+      bool truncated = tokens[i + 1].size() >= 3 &&
+                       tokens[i + 1].compare(tokens[i + 1].size() - 3, 3,
+                                             ":..") == 0;
+      if (truncated || !parse_hex(tokens[i + 1], data)) {
+        skipped += event == "RX";
+        code_len = 0;
+      } else if (event == "TX") {
+        code_len = data.size();
+      } else if (code_len > 0) {
+        t.responses.push_back(make_response(data, code_len));
+        code_len = 0;
+      }
+      break;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+// Decodes every response with the engine and the reference from the same
+// starting state, and compares the result after each one.
+static uint32_t check_decode(const Trace &t) {
+  ReplayDaikinS21 engine;
+  S21DecodedState ref = engine.decoded_state();
+  uint32_t mismatches = 0;
+  for (const Response &r : t.responses) {
+    bool parsed = engine.parse_response(r.rcode, r.payload);
+    bool ref_parsed = s21_reference_decode(r.frame, r.rcode.size(), ref);
+    S21DecodedState state = engine.decoded_state();
+    if (parsed != ref_parsed || state != ref) {
+      mismatches++;
+      printf("%s: decoder mismatch on %s\n", t.name.c_str(),
+             str_repr(r.frame).c_str());
+      printf("  engine:    %s%s\n", state.to_string().c_str(),
+             parsed ? "" : " (rejected)");
+      printf("  reference: %s%s\n", ref.to_string().c_str(),
+             ref_parsed ? "" : " (rejected)");
+      // Carry on from the engine's view, so one difference is reported once.
+      ref = state;
+    }
+  }
+  return mismatches;
+}
+
+template<typename F> static double time_ns(uint32_t rounds, F &&decode_all) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < rounds; i++)
+    decode_all();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count();
+}
+
+static uint32_t replay(Trace &t, uint32_t rounds) {
+  uint32_t mismatches = t.line.empty() ? 0 : read_line(t);
+  mismatches += check_decode(t);
+  if (t.responses.empty()) {
+    printf("%-16s %8s\n", t.name.c_str(), "no responses");
+    return mismatches;
+  }
+
+  ReplayDaikinS21 engine;
+  double engine_ns = time_ns(rounds, [&]() {
+    for (const Response &r : t.responses)
+      engine.parse_response(r.rcode, r.payload);
+  });
+  S21DecodedState ref;
+  double reference_ns = time_ns(rounds, [&]() {
+    for (const Response &r : t.responses)
+      s21_reference_decode(r.frame, r.rcode.size(), ref);
+  });
+  double frames = (double) t.responses.size() * rounds;
+  printf("%-16s %8zu %10" PRIu32 " %10.0f %12.0f %7.2fx\n", t.name.c_str(),
+         t.responses.size(), mismatches, engine_ns / frames,
+         reference_ns / frames, reference_ns / engine_ns);
+  return mismatches;
+}
+
+// D1 and D5 payloads for every mode, fan and swing setting over the whole
+// setpoint range, in quarter degrees so rounding is covered too.
+static uint32_t check_commands(size_t &count) {
+  static const DaikinClimateMode MODES[] = {
+      DaikinClimateMode::Disabled, DaikinClimateMode::Auto,
+      DaikinClimateMode::Dry,      DaikinClimateMode::Cool,
+      DaikinClimateMode::Heat,     DaikinClimateMode::Fan};
+  static const DaikinFanMode FANS[] = {
+      DaikinFanMode::Auto,   DaikinFanMode::Silent, DaikinFanMode::Speed1,
+      DaikinFanMode::Speed2, DaikinFanMode::Speed3, DaikinFanMode::Speed4,
+      DaikinFanMode::Speed5};
+  ReplayDaikinS21 engine;
+  uint8_t out[S21_COMMAND_PAYLOAD_SIZE];
+  uint8_t ref[S21_COMMAND_PAYLOAD_SIZE];
+  uint32_t mismatches = 0;
+  auto compare = [&](const char *code) {
+    count++;
+    if (memcmp(out, ref, sizeof(out)) != 0) {
+      mismatches++;
+      printf("%s encoder mismatch: engine %s, reference %s\n", code,
+             str_repr(out, sizeof(out)).c_str(),
+             str_repr(ref, sizeof(ref)).c_str());
+    }
+  };
+  for (int power = 0; power < 2; power++) {
+    for (DaikinClimateMode mode : MODES) {
+      for (DaikinFanMode fan : FANS) {
+        for (int q = 10 * 4; q <= 32 * 4; q++) {
+          float setpoint = q / 4.0f;
+          engine.climate_payload(out, power, mode, setpoint, fan);
+          s21_reference_d1(power, (uint8_t) mode, setpoint, (uint8_t) fan,
+                           ref);
+          compare("D1");
+        }
+      }
+    }
+  }
+  for (int swing = 0; swing < 4; swing++) {
+    engine.swing_payload(out, swing & 1, swing & 2);
+    s21_reference_d5(swing & 1, swing & 2, ref);
+    compare("D5");
+  }
+  return mismatches;
+}
+
+int main(int argc, char **argv) {
+  host::log_level = ESPHOME_LOG_LEVEL_NONE;
+  const char *env = getenv("S21_REPLAY_ROUNDS");
+  uint32_t rounds = env != nullptr ? atoi(env) : 200;
+  if (rounds == 0)
+    rounds = 1;
+
+  std::vector<Trace> traces = {running_trace(), noisy_trace()};
+  size_t skipped = 0;
+  for (int i = 1; i < argc; i++) {
+    Trace t;
+    if (!load_trace(argv[i], t, skipped))
+      return 1;
+    traces.push_back(std::move(t));
+  }
+
+  printf("%-16s %8s %10s %10s %12s %8s\n", "trace", "frames", "mismatches",
+         "engine_ns", "reference_ns", "speedup");
+  uint32_t mismatches = 0;
+  for (Trace &t : traces)
+    mismatches += replay(t, rounds);
+  size_t commands = 0;
+  mismatches += check_commands(commands);
+  printf("%zu command payloads compared", commands);
+  if (skipped > 0)
+    printf(", %zu truncated responses skipped", skipped);
+  printf("\n");
+  if (mismatches > 0) {
+    printf("%" PRIu32 " mismatches\n", mismatches);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "esphome/components/daikin_s21/s21.h"
+#include "esphome/components/s21_sim/s21_sim.h"
+#include "host.h"
+
+namespace esphome {
+namespace host {
+
+// A DaikinS21 master and a simulated unit on a virtual serial line, on a
+// freshly reset host.
+class S21Rig {
+ public:
+  explicit S21Rig(uint32_t update_interval_ms = 2000) {
+    reset();
+    this->master_uart.connect(&this->unit_uart);
+    this->master.set_uarts(&this->master_uart, &this->master_uart);
+    this->master.set_component_id("s21");
+    this->master.set_update_interval(update_interval_ms);
+    this->unit.set_uart_parent(&this->unit_uart);
+    this->unit.set_name("unit");
+    this->unit.set_timing_report_interval(0);
+  }
+  ~S21Rig() { reset(); }
+
+  // Adds both components, and runs until the master holds valid state.
+  bool start(uint32_t timeout_ms = 30000) {
+    add_component(&this->unit);
+    add_component(&this->master);
+    return run_until([this]() { return this->master.is_ready(); },
+                     timeout_ms);
+  }
+
+  HostUart master_uart;
+  HostUart unit_uart;
+  daikin_s21::DaikinS21 master;
+  s21_sim::S21SIM unit;
+};
+
+}  // namespace host
+}  // namespace esphome
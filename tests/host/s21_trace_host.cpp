@@ -0,0 +1,37 @@
+// Runs a DaikinS21 master against the simulator on the virtual clock and
+// writes its transaction timeline as Chrome trace JSON, for chrome://tracing
+// or ui.perfetto.dev.
+//
+//     s21_trace_host [seconds] [out.json]
+
+#include <cstdlib>
+#include <cstring>
+#include "s21_rig.h"
+
+using namespace esphome;
+using namespace esphome::daikin_s21;
+
+int main(int argc, char **argv) {
+  uint32_t seconds = argc > 1 ? atoi(argv[1]) : 10;
+  const char *path = argc > 2 ? argv[2] : "s21_trace.json";
+
+  host::S21Rig rig;
+  HOST_CHECK(rig.start());
+  host::run_for(seconds * 1000);
+
+  S21StringStream json;
+  rig.master.get_tracer().write_json(&json);
+  FILE *out = fopen(path, "w");
+  HOST_CHECK(out != nullptr);
+  fputs(json.str.c_str(), out);
+  fclose(out);
+  printf("%zu trace points over %" PRIu32 "s written to %s\n",
+         rig.master.get_tracer().size(), seconds, path);
+
+  // At least one complete F1 transaction slice.
+  HOST_CHECK(strstr(json.str.c_str(), "{\"name\":\"F1\",\"ph\":\"B\"") !=
+             nullptr);
+  HOST_CHECK(strstr(json.str.c_str(), "{\"name\":\"F1\",\"ph\":\"E\"") !=
+             nullptr);
+  return 0;
+}
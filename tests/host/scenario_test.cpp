@@ -0,0 +1,57 @@
+// Runs a simulator scenario against the master on the virtual clock: remote
+// changes, a defrost, a cable drop and a reboot. Every step must be seen by
+// the master within its deadline, and the master's state must show it.
+
+#include "s21_rig.h"
+
+using namespace esphome;
+using namespace esphome::daikin_s21;
+using esphome::s21_sim::S21ScenarioAction;
+
+// Runs until step n (from 1) has passed; false if any step failed first.
+static bool step_passed(s21_sim::S21SIM &unit, uint8_t n) {
+  return host::run_until(
+             [&]() {
+               return unit.get_steps_passed() >= n ||
+                      unit.get_steps_failed() > 0;
+             },
+             60000) &&
+         unit.get_steps_failed() == 0;
+}
+
+int main() {
+  host::S21Rig rig;
+  HOST_CHECK(rig.start());
+
+  s21_sim::S21SIM &unit = rig.unit;
+  unit.add_scenario_step(S21ScenarioAction::Setpoint, 215, 1000, 5000);
+  unit.add_scenario_step(S21ScenarioAction::Mode, '4', 6000, 5000);
+  unit.add_scenario_step(S21ScenarioAction::Fan, '5', 11000, 5000);
+  unit.add_scenario_step(S21ScenarioAction::Defrost, 8000, 16000, 20000);
+  unit.add_scenario_step(S21ScenarioAction::Disconnect, 8000, 40000, 15000);
+  unit.add_scenario_step(S21ScenarioAction::Reboot, 3000, 70000, 15000);
+  unit.add_scenario_step(S21ScenarioAction::Power, 0, 100000, 5000);
+  unit.start_scenario();
+
+  // A step only passes once the master has acknowledged a reply showing
+  // it, so the master must hold the new state by then.
+  HOST_CHECK(step_passed(unit, 1));
+  HOST_CHECK(rig.master.get_setpoint() == 21.5f);
+  HOST_CHECK(step_passed(unit, 2));
+  HOST_CHECK(rig.master.get_climate_mode() == DaikinClimateMode::Heat);
+  HOST_CHECK(step_passed(unit, 3));
+  HOST_CHECK(rig.master.get_fan_mode() == DaikinFanMode::Speed3);
+  HOST_CHECK(step_passed(unit, 4));
+  HOST_CHECK(rig.master.get_fan_rpm() == 0);
+  HOST_CHECK(step_passed(unit, 5));
+  HOST_CHECK(rig.master.get_climate_mode() == DaikinClimateMode::Heat);
+  // Back at its power-on defaults after the reboot.
+  HOST_CHECK(step_passed(unit, 6));
+  HOST_CHECK(rig.master.get_climate_mode() == DaikinClimateMode::Cool);
+  HOST_CHECK(rig.master.get_setpoint() == 23.5f);
+  HOST_CHECK(step_passed(unit, 7));
+  HOST_CHECK(!rig.master.is_power_on());
+  HOST_CHECK(host::run_until([&]() { return unit.is_scenario_finished(); },
+                             10000));
+  return 0;
+}
@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""
+Receiver for daikin_s21 multicast state beacons.
+
+Decodes the fixed layout documented in components/daikin_s21/s21_beacon.h and
+keeps the latest beacon per node. A single thread drains the socket, which is
+plenty for hundreds of units at the default heartbeat rate.
+
+    python3 tools/s21_beacon.py [--group 239.255.21.21] [--port 52100]
+"""
+
+import argparse
+import selectors
+import socket
+import struct
+import time
+from collections import namedtuple
+
+MAGIC = b"S21B"
+VERSION = 1
+SIZE = 64
+LAYOUT = struct.Struct("<4sBBBBIIhhhhHHIIIII16s")
+
+FLAG_POWER = 1 << 0
+FLAG_IDLE = 1 << 1
+FLAG_SWING_V = 1 << 2
+FLAG_SWING_H = 1 << 3
+FLAG_READY = 1 << 4
+FLAG_HEARTBEAT = 1 << 5
+
+# Datagrams can arrive out of order, but not by more than a few seconds or a
+# few dozen beacons. A bigger step back means the node restarted.
+REORDER_SECONDS = 2
+REORDER_BEACONS = 64
+
+Beacon = namedtuple(
+    "Beacon",
+    [
+        "flags",
+        "mode",
+        "fan",
+        "node_id",
+        "seq",
+        "setpoint",
+        "temp_inside",
+        "temp_outside",
+        "temp_coil",
+        "fan_rpm",
+        "transactions",
+        "naks",
+        "timeouts",
+        "checksum_errors",
+        "uptime_s",
+        "name",
+    ],
+)
+
+
+def decode(data):
+    """Decode one datagram, returning a Beacon or None if malformed."""
+    if len(data) < SIZE:
+        return None
+    fields = LAYOUT.unpack_from(data)
+    if fields[0] != MAGIC or fields[1] != VERSION:
+        return None
+    (_, _, flags, mode, fan, node_id, seq, sp, tin, tout, tcoil, rpm, _) = fields[
+        :13
+    ]
+    return Beacon(
+        flags,
+        chr(mode),
+        chr(fan),
+        node_id,
+        seq,
+        sp / 10.0,
+        tin / 10.0,
+        tout / 10.0,
+        tcoil / 10.0,
+        rpm,
+        *fields[13:18],
+        fields[18].rstrip(b"\0").decode(errors="replace"),
+    )
+
+
+def restarted(beacon, prev):
+    """Whether beacon comes from a later boot of the node than prev."""
+    return (
+        beacon.uptime_s + REORDER_SECONDS < prev.uptime_s
+        or beacon.seq + REORDER_BEACONS < prev.seq
+    )
+
+
+class BeaconReceiver:
+    """Joins the beacon group and tracks the latest beacon per node id."""
+
+    def __init__(self, group="239.255.21.21", port=52100, interface="0.0.0.0"):
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.sock.bind(("", port))
+        mreq = socket.inet_aton(group) + socket.inet_aton(interface)
+        self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+        self.sock.setblocking(False)
+        self.selector = selectors.DefaultSelector()
+        self.selector.register(self.sock, selectors.EVENT_READ)
+        self.nodes = {}  # node_id -> (Beacon, receive time, source address)
+        self.dropped = 0
+
+    def poll(self, timeout=None):
+        """Drain pending datagrams; returns the beacons decoded this call."""
+        received = []
+        if not self.selector.select(timeout):
+            return received
+        while True:
+            try:
+                data, addr = self.sock.recvfrom(SIZE * 2)
+            except BlockingIOError:
+                break
+            beacon = decode(data)
+            if beacon is None:
+                self.dropped += 1
+                continue
+            prev = self.nodes.get(beacon.node_id)
+            if (
+                prev is not None
+                and beacon.seq <= prev[0].seq
+                and not restarted(beacon, prev[0])
+            ):
+                continue  # Duplicate or reordered
+            self.nodes[beacon.node_id] = (beacon, time.monotonic(), addr[0])
+            received.append(beacon)
+        return received
+
+    def close(self):
+        self.selector.close()
+        self.sock.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--group", default="239.255.21.21")
+    parser.add_argument("--port", type=int, default=52100)
+    parser.add_argument("--interface", default="0.0.0.0")
+    args = parser.parse_args()
+
+    rx = BeaconReceiver(args.group, args.port, args.interface)
+    try:
+        while True:
+            for b in rx.poll():
+                print(
+                    f"{b.name:16} {b.node_id:08x} #{b.seq:<6} "
+                    f"{'ON ' if b.flags & FLAG_POWER else 'OFF'} mode={b.mode} "
+                    f"fan={b.fan} sp={b.setpoint:.1f} in={b.temp_inside:.1f} "
+                    f"out={b.temp_outside:.1f} tx={b.transactions} "
+                    f"nak={b.naks} to={b.timeouts} cs={b.checksum_errors}"
+                    f"{' (heartbeat)' if b.flags & FLAG_HEARTBEAT else ''}"
+                )
+    except KeyboardInterrupt:
+        pass
+    finally:
+        rx.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+"""
+Generate an s21_sim profile from traffic captured on a real unit.
+
+Reads either the protocol trace daikin_s21 dumps to the log with
+`debug_protocol: true`, or a raw byte capture of the bus. From it, infers
+which queries the unit answers, a representative reply to each, the unit's
+response latency, how often it NAKs, and any fixed checksum offset. Prints
+the result as an s21_sim `profile:` block to paste under an s21_sim entry.
+
+    python3 tools/s21_sim_profile.py --trace esphome.log > profile.yaml
+    python3 tools/s21_sim_profile.py --capture bus.csv > profile.yaml
+
+A raw capture is CSV with one byte per line: "time,direction,byte". Time is
+in seconds. Direction is "master" or "unit" ("m"/"u" also work). The byte is
+hex ("0x46" or "46"). A header line is skipped. Most logic analyser async
+serial exports map onto this with a column rename.
+"""
+
+import argparse
+import csv
+import re
+import statistics
+import sys
+from collections import Counter, defaultdict
+
+STX = 0x02
+ETX = 0x03
+ACK = 0x06
+NAK = 0x15
+
+# One byte at 2400 baud, 8 data bits, even parity, 2 stop bits.
+BYTE_TIME_MS = 12 * 1000 / 2400
+
+# "      1234 RX      47:31:30:33:4B:41", possibly after an ESPHome log
+# prefix, and with ":.." when the trace kept only the first 8 bytes.
+TRACE_LINE = re.compile(
+    r"(?:^|\]:)\s*(\d+) (TX|RX|ACK|NAK|JUNK|XACK|TIMEOUT|CSUM)\b\s*"
+    r"((?:[0-9A-F]{2}:)*[0-9A-F]{2})?(:\.\.)?\s*$"
+)
+
+
+class Exchange:
+    """One request and what the unit did about it."""
+
+    def __init__(self, request, time_ms):
+        self.request = request
+        self.time_ms = time_ms  # Request sent (trace) or received (capture)
+        self.outcome = None  # "frame", "nak", "checksum" or None (timeout)
+        self.response = None
+        self.truncated = False
+        self.latency_ms = None
+        self.checksum_offset = None
+
+    @property
+    def query(self):
+        return self.request.decode("ascii", errors="replace")
+
+
+def read_trace(lines, byte_time_ms):
+    """Exchanges from protocol trace dumps, which may overlap."""
+    seen = set()
+    events = []
+    for line in lines:
+        match = TRACE_LINE.search(line.rstrip("\n"))
+        if match is None:
+            continue
+        key = match.group(1, 2, 3)
+        if key in seen:
+            continue  # Same event in a later dump
+        seen.add(key)
+        data = bytes.fromhex(match.group(3).replace(":", "")) if match.group(3) else b""
+        events.append((int(match.group(1)), match.group(2), data, bool(match.group(4))))
+    events.sort(key=lambda e: e[0])
+
+    exchanges = []
+    current = None
+    for ms, event, data, truncated in events:
+        if event == "TX":
+            current = Exchange(data, ms)
+            current.truncated = truncated
+            exchanges.append(current)
+            continue
+        if current is None or current.outcome is not None:
+            continue
+        # The trace stamps the request before it goes out and the reply once
+        # it is in, so take the bytes on the wire off the difference.
+        request_bytes = len(current.request) + 3
+        if event == "NAK":
+            current.outcome = "nak"
+            wire = (request_bytes + 1) * byte_time_ms
+            current.latency_ms = max(0, ms - current.time_ms - wire)
+        elif event in ("RX", "CSUM"):
+            current.outcome = "frame" if event == "RX" else "checksum"
+            current.response = data
+            current.truncated = truncated
+            wire = (request_bytes + 1 + len(data) + 3) * byte_time_ms
+            current.latency_ms = max(0, ms - current.time_ms - wire)
+    return exchanges
+
+
+def read_capture(rows):
+    """Exchanges from a raw capture of both directions."""
+    exchanges = []
+    current = None
+    frames = {"master": None, "unit": None}  # Bytes of a frame being read
+    acked_ms = None
+    for row in rows:
+        if len(row) < 3:
+            continue
+        try:
+            ms = float(row[0]) * 1000
+            byte = int(row[2], 16)
+        except ValueError:
+            continue  # Header
+        side = "master" if row[1].strip().lower() in ("m", "master") else "unit"
+        frame = frames[side]
+        if frame is None:
+            if byte == STX:
+                frames[side] = bytearray()
+            elif side == "unit" and current is not None and current.outcome is None:
+                if byte == ACK:
+                    acked_ms = ms
+                elif byte == NAK:
+                    current.outcome = "nak"
+                    current.latency_ms = ms - current.time_ms
+            continue
+        if byte == STX:
+            frames[side] = bytearray()  # Restart, the last one was cut short
+        elif byte != ETX:
+            frame.append(byte)
+            continue
+        frames[side] = None
+        if len(frame) < 2:
+            continue
+        payload, checksum = bytes(frame[:-1]), frame[-1]
+        if side == "master":
+            current = Exchange(payload, ms)
+            acked_ms = None
+            exchanges.append(current)
+        elif current is not None and current.outcome is None:
+            current.outcome = "frame"
+            current.response = payload
+            current.checksum_offset = (checksum - sum(payload)) & 0xFF
+            if acked_ms is not None:
+                current.latency_ms = acked_ms - current.time_ms
+    return exchanges
+
+
+def percentile(values, fraction):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(fraction * len(values)))]
+
+
+def profile_lines(exchanges, source):
+    """The profile as YAML lines, one entry per query seen."""
+    by_query = defaultdict(list)
+    for exchange in exchanges:
+        if exchange.request[:1] == b"D":
+            continue  # Commands are simulated from state, not replayed
+        by_query[exchange.query].append(exchange)
+
+    lines = [
+        f"# s21_sim profile from {source}: {len(exchanges)} exchanges",
+        "profile:",
+    ]
+    for query in sorted(by_query):
+        attempts = by_query[query]
+        answers = [e for e in attempts if e.outcome in ("frame", "checksum")]
+        naks = [e for e in attempts if e.outcome == "nak"]
+        if not answers and not naks:
+            lines.append(f"  # {query}: no reply in {len(attempts)} attempts")
+            continue
+        lines.append(f"  - query: {query}")
+        if answers:
+            replies = Counter(e.response for e in answers)
+            response, count = replies.most_common(1)[0]
+            text = "".join(chr(b) if 32 <= b < 127 else "." for b in response)
+            note = f"{count}/{len(answers)} replies"
+            if any(e.truncated and e.response == response for e in answers):
+                note += ", cut short by the trace"
+            lines.append(
+                f'    response: "{response.hex(":").upper()}"  # "{text}", {note}'
+            )
+        nak_rate = len(naks) / (len(naks) + len(answers))
+        if nak_rate > 0:
+            lines.append(f"    nak_rate: {nak_rate:.0%}  # {len(naks)} NAKs")
+        latencies = [e.latency_ms for e in answers + naks if e.latency_ms is not None]
+        if latencies:
+            lines.append(
+                f"    latency: {round(statistics.median(latencies))}ms"
+                f"  # p90 {percentile(latencies, 0.9):.0f}ms,"
+                f" max {max(latencies):.0f}ms"
+            )
+        offsets = Counter(
+            e.checksum_offset for e in answers if e.checksum_offset is not None
+        )
+        if offsets:
+            offset, count = offsets.most_common(1)[0]
+            if offset != 0 and count >= 0.9 * len(answers):
+                lines.append(f"    checksum_offset: {offset}")
+        bad = sum(1 for e in answers if e.outcome == "checksum")
+        if bad:
+            lines.append(
+                f"    # {bad}/{len(answers)} replies failed the checksum;"
+                " a raw capture shows whether the offset is fixed"
+            )
+    return lines
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--trace", help="log with daikin_s21 trace dumps")
+    source.add_argument("--capture", help="raw bus capture, time,direction,byte")
+    parser.add_argument(
+        "--byte-time",
+        type=float,
+        default=BYTE_TIME_MS,
+        help="ms per byte on the wire, for trace latencies (default: 2400 8E2)",
+    )
+    args = parser.parse_args()
+
+    if args.trace:
+        with open(args.trace, encoding="utf-8", errors="replace") as f:
+            exchanges = read_trace(f, args.byte_time)
+        source_name = args.trace
+    else:
+        with open(args.capture, newline="", encoding="utf-8") as f:
+            exchanges = read_capture(csv.reader(f))
+        source_name = args.capture
+    if not exchanges:
+        sys.exit(f"No exchanges found in {source_name}")
+    print("\n".join(profile_lines(exchanges, source_name)))
+
+
+if __name__ == "__main__":
+    main()